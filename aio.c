@@ -0,0 +1,625 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+#endif
+
+#include "aio.h"
+
+#define AIO_CHUNK (1 << 16)
+#define AIO_DEPTH 4
+
+//
+// Thread backend: one helper thread and two buffers per stream.
+//
+
+typedef struct {
+    FILE *file;
+    uint8_t *buf[2];
+    size_t len[2];
+    bool full[2];
+    size_t cur;
+    size_t pos;
+    bool stop;
+    bool failed;
+    bool writer;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} ThreadStream;
+
+// FILLS buffers ahead of the consumer until the input runs out or the stream closes.
+static void *read_ahead(void *arg) {
+    ThreadStream *s = (ThreadStream *) arg;
+
+    for (size_t i = 0;; i ^= 1) {
+        pthread_mutex_lock(&s->lock);
+        while (s->full[i] && !s->stop) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (s->stop) {
+            break;
+        }
+
+        size_t n = fread(s->buf[i], sizeof(uint8_t), AIO_CHUNK, s->file);
+
+        pthread_mutex_lock(&s->lock);
+        s->len[i] = n;
+        s->full[i] = true;
+        s->failed = ferror(s->file) != 0;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+
+        // An empty buffer marks the end of the input and stays full for good.
+        if (n == 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+// WRITES buffers handed over by the producer until the stream closes.
+static void *write_behind(void *arg) {
+    ThreadStream *s = (ThreadStream *) arg;
+
+    for (size_t i = 0;; i ^= 1) {
+        pthread_mutex_lock(&s->lock);
+        while (!s->full[i] && !s->stop) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        pthread_mutex_unlock(&s->lock);
+
+        if (!s->full[i]) {
+            break;
+        }
+
+        bool ok = fwrite(s->buf[i], sizeof(uint8_t), s->len[i], s->file) == s->len[i];
+
+        pthread_mutex_lock(&s->lock);
+        s->failed = s->failed || !ok;
+        s->full[i] = false;
+        s->len[i] = 0;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    }
+
+    return NULL;
+}
+
+static ssize_t thread_read(void *cookie, char *buf, size_t size) {
+    ThreadStream *s = (ThreadStream *) cookie;
+    size_t copied = 0;
+
+    pthread_mutex_lock(&s->lock);
+
+    while (copied < size) {
+        while (!s->full[s->cur]) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+
+        if (s->failed) {
+            pthread_mutex_unlock(&s->lock);
+            return -1;
+        }
+
+        if (s->len[s->cur] == 0) {
+            break;
+        }
+
+        size_t n = s->len[s->cur] - s->pos;
+        n = n < size - copied ? n : size - copied;
+        memcpy(buf + copied, s->buf[s->cur] + s->pos, n);
+        copied += n;
+        s->pos += n;
+
+        // HAND the drained buffer back to the reader thread.
+        if (s->pos == s->len[s->cur]) {
+            s->full[s->cur] = false;
+            s->pos = 0;
+            s->cur ^= 1;
+            pthread_cond_broadcast(&s->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&s->lock);
+
+    return copied;
+}
+
+// HANDS the current buffer to the writer thread and WAITS for the other one to be free.
+static void thread_hand_off(ThreadStream *s) {
+    pthread_mutex_lock(&s->lock);
+    s->full[s->cur] = true;
+    pthread_cond_broadcast(&s->cond);
+    s->cur ^= 1;
+    while (s->full[s->cur]) {
+        pthread_cond_wait(&s->cond, &s->lock);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+static ssize_t thread_write(void *cookie, const char *buf, size_t size) {
+    ThreadStream *s = (ThreadStream *) cookie;
+    size_t written = 0;
+
+    while (written < size) {
+        size_t n = AIO_CHUNK - s->len[s->cur];
+        n = n < size - written ? n : size - written;
+        memcpy(s->buf[s->cur] + s->len[s->cur], buf + written, n);
+        s->len[s->cur] += n;
+        written += n;
+
+        if (s->len[s->cur] == AIO_CHUNK) {
+            thread_hand_off(s);
+        }
+    }
+
+    return s->failed ? -1 : (ssize_t) size;
+}
+
+static int thread_close(void *cookie) {
+    ThreadStream *s = (ThreadStream *) cookie;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->writer && s->len[s->cur] > 0) {
+        s->full[s->cur] = true;
+    }
+    s->stop = true;
+    pthread_cond_broadcast(&s->cond);
+    pthread_mutex_unlock(&s->lock);
+
+    pthread_join(s->thread, NULL);
+
+    bool failed = s->failed;
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s->buf[0]);
+    free(s);
+
+    return failed ? -1 : 0;
+}
+
+// STARTS a thread-backed stream over 'file'.
+static FILE *thread_open(FILE *file, bool writer) {
+    ThreadStream *s = (ThreadStream *) calloc(1, sizeof(ThreadStream));
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->file = file;
+    s->writer = writer;
+    s->buf[0] = (uint8_t *) malloc(2 * AIO_CHUNK);
+    s->buf[1] = s->buf[0] + AIO_CHUNK;
+
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+
+    void *(*body)(void *) = writer ? write_behind : read_ahead;
+
+    if (s->buf[0] == NULL || pthread_create(&s->thread, NULL, body, s) != 0) {
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+        free(s->buf[0]);
+        free(s);
+        return NULL;
+    }
+
+    cookie_io_functions_t io = { .read = thread_read, .write = thread_write, .close = thread_close };
+
+    return fopencookie(s, writer ? "w" : "r", io);
+}
+
+#ifdef HAVE_IO_URING
+
+//
+// io_uring backend: AIO_DEPTH buffers in flight at explicit file offsets.
+//
+
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+} Ring;
+
+typedef struct {
+    Ring ring;
+    FILE *file;
+    int fd;
+    uint8_t *buf[AIO_DEPTH];
+    struct iovec iov[AIO_DEPTH];
+    off_t off[AIO_DEPTH];
+    int32_t res[AIO_DEPTH];
+    bool busy[AIO_DEPTH];
+    off_t next_off;
+    size_t cur;
+    size_t pos;
+    bool eof;
+    bool failed;
+} UringStream;
+
+// SETS up an io_uring instance and maps its queues.
+static bool ring_init(Ring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+
+    r->fd = syscall(__NR_io_uring_setup, entries, &p);
+
+    if (r->fd < 0) {
+        return false;
+    }
+
+    r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    r->sq_ring = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+        IORING_OFF_SQ_RING);
+    r->cq_ring = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+        IORING_OFF_CQ_RING);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+        IORING_OFF_SQES);
+
+    if (r->sq_ring == MAP_FAILED || r->cq_ring == MAP_FAILED || r->sqes == MAP_FAILED) {
+        close(r->fd);
+        return false;
+    }
+
+    uint8_t *sq = (uint8_t *) r->sq_ring;
+    uint8_t *cq = (uint8_t *) r->cq_ring;
+
+    r->sq_tail = (unsigned *) (sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *) (sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *) (sq + p.sq_off.array);
+    r->cq_head = (unsigned *) (cq + p.cq_off.head);
+    r->cq_tail = (unsigned *) (cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *) (cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    return true;
+}
+
+static void ring_exit(Ring *r) {
+    munmap(r->sqes, r->sqes_size);
+    munmap(r->cq_ring, r->cq_size);
+    munmap(r->sq_ring, r->sq_size);
+    close(r->fd);
+}
+
+// SUBMITS one readv or writev of 'iov' at 'off', tagged with 'tag'.
+static bool ring_submit(Ring *r, uint8_t op, int fd, struct iovec *iov, off_t off, uint64_t tag) {
+    unsigned tail = *r->sq_tail;
+    unsigned index = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t) (uintptr_t) iov;
+    sqe->len = 1;
+    sqe->off = off;
+    sqe->user_data = tag;
+
+    r->sq_array[index] = index;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    return syscall(__NR_io_uring_enter, r->fd, 1, 0, 0, NULL, 0) == 1;
+}
+
+// WAITS for the next completion, storing its tag and result.
+static bool ring_wait(Ring *r, uint64_t *tag, int32_t *res) {
+    unsigned head = *r->cq_head;
+
+    while (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        if (syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+            && errno != EINTR) {
+            return false;
+        }
+    }
+
+    struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+    *tag = cqe->user_data;
+    *res = cqe->res;
+
+    __atomic_store_n(r->cq_head, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+// REAPS completions until buffer 'b' is no longer in flight.
+static bool uring_settle(UringStream *s, size_t b) {
+    while (s->busy[b]) {
+        uint64_t tag;
+        int32_t res;
+
+        if (!ring_wait(&s->ring, &tag, &res)) {
+            return false;
+        }
+
+        s->busy[tag] = false;
+        s->res[tag] = res;
+    }
+
+    return s->res[b] >= 0;
+}
+
+// QUEUES a read of buffer 'b' at the next unread offset.
+static bool uring_queue_read(UringStream *s, size_t b) {
+    s->iov[b].iov_len = AIO_CHUNK;
+    s->off[b] = s->next_off;
+    s->next_off += AIO_CHUNK;
+    s->busy[b] = true;
+
+    return ring_submit(&s->ring, IORING_OP_READV, s->fd, &s->iov[b], s->off[b], b);
+}
+
+static ssize_t uring_read(void *cookie, char *buf, size_t size) {
+    UringStream *s = (UringStream *) cookie;
+    size_t copied = 0;
+
+    while (copied < size && !s->eof) {
+        size_t b = s->cur;
+
+        if (!uring_settle(s, b)) {
+            return -1;
+        }
+
+        size_t len = s->res[b];
+
+        if (len == 0) {
+            s->eof = true;
+            break;
+        }
+
+        size_t n = len - s->pos < size - copied ? len - s->pos : size - copied;
+        memcpy(buf + copied, s->buf[b] + s->pos, n);
+        copied += n;
+        s->pos += n;
+
+        if (s->pos < len) {
+            continue;
+        }
+
+        // A short read means the reads queued after it started too far ahead:
+        // let them finish, then REQUEUE all of them from where this one ended.
+        if (len < AIO_CHUNK) {
+            for (size_t i = 0; i < AIO_DEPTH; i += 1) {
+                uring_settle(s, i);
+            }
+
+            s->next_off = s->off[b] + len;
+
+            for (size_t i = 1; i <= AIO_DEPTH; i += 1) {
+                if (!uring_queue_read(s, (b + i) % AIO_DEPTH)) {
+                    return -1;
+                }
+            }
+        } else if (!uring_queue_read(s, b)) {
+            return -1;
+        }
+
+        s->pos = 0;
+        s->cur = (b + 1) % AIO_DEPTH;
+    }
+
+    return copied;
+}
+
+// QUEUES a write of the filled part of buffer 'b'.
+static bool uring_queue_write(UringStream *s, size_t b) {
+    s->iov[b].iov_len = s->pos;
+    s->off[b] = s->next_off;
+    s->next_off += s->pos;
+    s->busy[b] = true;
+
+    return ring_submit(&s->ring, IORING_OP_WRITEV, s->fd, &s->iov[b], s->off[b], b);
+}
+
+// WAITS for buffer 'b' to be written, finishing a short write synchronously.
+static bool uring_finish_write(UringStream *s, size_t b) {
+    if (!uring_settle(s, b)) {
+        return false;
+    }
+
+    size_t done = s->res[b];
+    size_t len = s->iov[b].iov_len;
+
+    while (done < len) {
+        ssize_t n = pwrite(s->fd, s->buf[b] + done, len - done, s->off[b] + done);
+
+        if (n <= 0) {
+            return false;
+        }
+        done += n;
+    }
+
+    s->res[b] = 0;
+    s->iov[b].iov_len = 0;
+
+    return true;
+}
+
+static ssize_t uring_write(void *cookie, const char *buf, size_t size) {
+    UringStream *s = (UringStream *) cookie;
+    size_t written = 0;
+
+    while (written < size) {
+        size_t n = AIO_CHUNK - s->pos < size - written ? AIO_CHUNK - s->pos : size - written;
+        memcpy(s->buf[s->cur] + s->pos, buf + written, n);
+        s->pos += n;
+        written += n;
+
+        if (s->pos < AIO_CHUNK) {
+            continue;
+        }
+
+        // SUBMIT the full buffer and MOVE to the next one once its last write is done.
+        if (!uring_queue_write(s, s->cur)) {
+            return -1;
+        }
+
+        s->cur = (s->cur + 1) % AIO_DEPTH;
+        s->pos = 0;
+
+        if (!uring_finish_write(s, s->cur)) {
+            s->failed = true;
+            return -1;
+        }
+    }
+
+    return size;
+}
+
+static int uring_close(void *cookie) {
+    UringStream *s = (UringStream *) cookie;
+    bool failed = s->failed;
+
+    if (s->file != NULL) {
+        // FLUSH the partly filled buffer and WAIT for every write.
+        if (s->pos > 0 && !uring_queue_write(s, s->cur)) {
+            failed = true;
+        }
+
+        for (size_t i = 0; i < AIO_DEPTH; i += 1) {
+            failed = !uring_finish_write(s, i) || failed;
+        }
+
+        // LEAVE the wrapped stream positioned after everything written through it.
+        lseek(s->fd, s->next_off, SEEK_SET);
+        fseeko(s->file, s->next_off, SEEK_SET);
+    } else {
+        // WAIT for reads still in flight before their buffers are freed.
+        for (size_t i = 0; i < AIO_DEPTH; i += 1) {
+            uring_settle(s, i);
+        }
+    }
+
+    ring_exit(&s->ring);
+    free(s->buf[0]);
+    free(s);
+
+    return failed ? -1 : 0;
+}
+
+// STARTS an io_uring-backed stream over a regular file, or returns NULL.
+static FILE *uring_open(FILE *file, bool writer) {
+    struct stat st;
+
+    if (fflush(file) != 0 || fstat(fileno(file), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+
+    // O_APPEND would make every write land at the end regardless of its offset.
+    if (writer && (fcntl(fileno(file), F_GETFL) & O_APPEND) != 0) {
+        return NULL;
+    }
+
+    off_t start = ftello(file);
+
+    if (start < 0) {
+        return NULL;
+    }
+
+    UringStream *s = (UringStream *) calloc(1, sizeof(UringStream));
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+    if (!ring_init(&s->ring, AIO_DEPTH * 2)) {
+        free(s);
+        return NULL;
+    }
+
+    s->buf[0] = (uint8_t *) malloc(AIO_DEPTH * AIO_CHUNK);
+
+    if (s->buf[0] == NULL) {
+        ring_exit(&s->ring);
+        free(s);
+        return NULL;
+    }
+
+    s->fd = fileno(file);
+    s->file = writer ? file : NULL;
+    s->next_off = start;
+
+    for (size_t i = 0; i < AIO_DEPTH; i += 1) {
+        s->buf[i] = s->buf[0] + i * AIO_CHUNK;
+        s->iov[i].iov_base = s->buf[i];
+    }
+
+    // QUEUE the first reads right away so they overlap with the caller's setup.
+    for (size_t i = 0; !writer && i < AIO_DEPTH; i += 1) {
+        if (!uring_queue_read(s, i)) {
+            uring_close(s);
+            return NULL;
+        }
+    }
+
+    cookie_io_functions_t io = { .read = uring_read, .write = uring_write, .close = uring_close };
+
+    return fopencookie(s, writer ? "w" : "r", io);
+}
+
+#endif
+
+FILE *aio_reader(FILE *infile) {
+    FILE *stream = NULL;
+
+#ifdef HAVE_IO_URING
+    stream = uring_open(infile, false);
+#endif
+
+    if (stream == NULL) {
+        stream = thread_open(infile, false);
+    }
+
+    return stream != NULL ? stream : infile;
+}
+
+FILE *aio_writer(FILE *outfile) {
+    FILE *stream = NULL;
+
+#ifdef HAVE_IO_URING
+    stream = uring_open(outfile, true);
+#endif
+
+    if (stream == NULL) {
+        stream = thread_open(outfile, true);
+    }
+
+    return stream != NULL ? stream : outfile;
+}
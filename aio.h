@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Asynchronous stream wrappers that overlap file I/O with SS block work.
+// Regular files use io_uring where the kernel supports it; anything else
+// (pipes, terminals, older kernels) uses a reader or writer thread with
+// double buffering.
+//
+
+//
+// Wraps a stream in a read stream that keeps reads ahead of the consumer.
+//
+// Requires:
+//  infile: open and readable file stream (left open on close)
+//
+// Returns infile itself if no asynchronous backend could be started.
+//
+FILE *aio_reader(FILE *infile);
+
+//
+// Wraps a stream in a write stream whose writes complete behind the producer.
+// Closing the returned stream waits for every pending write.
+//
+// Requires:
+//  outfile: open and writable file stream (left open on close)
+//
+// Returns outfile itself if no asynchronous backend could be started.
+//
+FILE *aio_writer(FILE *outfile);
+
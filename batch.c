@@ -0,0 +1,539 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <gmp.h>
+
+#include "batch.h"
+#include "ss.h"
+#include "shard.h"
+#include "stats.h"
+
+// Inputs larger than one range are split into ranges of about this many bytes.
+#define RANGE_BYTES (1 << 20)
+
+// A file of the batch. Its ranges finish in any order but are written out in order.
+typedef struct {
+    char *in_name;
+    char *out_name;
+    FILE *out;
+    bool opened;
+    uint64_t num_ranges;
+    uint64_t next_flush;
+    char **outputs;
+    size_t *output_lens;
+    bool *done;
+    bool failed;
+    pthread_mutex_t lock;
+} Job;
+
+// A unit of work: one range of one job.
+typedef struct {
+    Job *job;
+    uint64_t range;
+    uint64_t offset;
+    uint64_t length;
+} Task;
+
+// A worker's queue. Owners and thieves both take the oldest task, so the ranges of a
+// file finish roughly in order and little output waits in memory to be flushed.
+typedef struct {
+    Task **tasks;
+    size_t head;
+    size_t tail;
+    pthread_mutex_t lock;
+} Deque;
+
+// What every task of a pool does with its range.
+typedef enum { MODE_ENCRYPT, MODE_DECRYPT, MODE_REENCRYPT } Mode;
+
+typedef struct {
+    Deque *deques;
+    uint64_t threads;
+    Mode mode;
+    Codec codec;
+    mpz_srcptr n;
+    mpz_srcptr d;
+    mpz_srcptr pq;
+} Pool;
+
+// The decrypting stage of a re-encryption, feeding plaintext into a pipe.
+typedef struct {
+    Pool *pool;
+    FILE *in;
+    FILE *out;
+    bool ok;
+} DecryptStage;
+
+typedef struct {
+    Pool *pool;
+    uint64_t self;
+} Worker;
+
+// TAKES the oldest task of a deque, or NULL if it is empty.
+static Task *deque_take(Deque *q) {
+    Task *task = NULL;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->head < q->tail) {
+        task = q->tasks[q->head++];
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return task;
+}
+
+// OPENS a job's output the first time it is needed, so only jobs in flight hold a descriptor.
+// Requires the job lock.
+static void job_open(Job *job) {
+    if (job->opened) {
+        return;
+    }
+
+    job->opened = true;
+    job->out = fopen(job->out_name, "w");
+
+    if (job->out == NULL) {
+        fprintf(stderr, "Error: Could not access %s.\n", job->out_name);
+        job->failed = true;
+    }
+}
+
+// WRITES every finished range of a job that is next in line, OPENING its output at the first
+// and CLOSING it after the last. Requires the job lock.
+static void job_flush(Job *job) {
+    if (job->next_flush < job->num_ranges && job->done[job->next_flush]) {
+        job_open(job);
+    }
+
+    while (job->next_flush < job->num_ranges && job->done[job->next_flush]) {
+        uint64_t r = job->next_flush;
+
+        if (job->outputs[r] != NULL) {
+            if (job->out == NULL
+                || fwrite(job->outputs[r], sizeof(char), job->output_lens[r], job->out)
+                       != job->output_lens[r]) {
+                job->failed = true;
+            }
+            free(job->outputs[r]);
+            job->outputs[r] = NULL;
+        }
+
+        job->next_flush += 1;
+    }
+
+    if (job->next_flush == job->num_ranges && job->out != NULL) {
+        if (fclose(job->out) != 0) {
+            job->failed = true;
+        }
+        job->out = NULL;
+    }
+}
+
+// DECRYPTS a stage's input into its pipe, then CLOSES the pipe so the encrypting side sees EOF.
+// Only the encrypting side is recorded in the statistics.
+static void *decrypt_stage(void *arg) {
+    DecryptStage *stage = (DecryptStage *) arg;
+
+    stats_ignore_thread();
+
+    bool decrypted = ss_decrypt_file(stage->in, stage->out, stage->pool->d, stage->pool->pq);
+
+    // FAIL on unparsable ciphertext, a read error, or a pipe the encrypting side closed.
+    stage->ok = decrypted && feof(stage->in) && ferror(stage->in) == 0 && ferror(stage->out) == 0;
+    stage->ok = (fclose(stage->out) == 0) && stage->ok;
+
+    return NULL;
+}
+
+// RE-ENCRYPTS 'infile' into 'outfile', decrypting on a second thread so both stages overlap.
+// Plaintext only passes through a pipe, and encryption re-blocks it for the new key.
+// Requires SIGPIPE to be ignored, so a failed encrypting side fails the decrypting side's writes.
+static bool reencrypt(Pool *pool, FILE *infile, FILE *outfile) {
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    FILE *plain_in = fdopen(fds[0], "r");
+    DecryptStage stage = { pool, infile, fdopen(fds[1], "w"), false };
+    pthread_t thread;
+
+    if (plain_in == NULL || stage.out == NULL
+        || pthread_create(&thread, NULL, decrypt_stage, &stage) != 0) {
+        if (plain_in != NULL) {
+            fclose(plain_in);
+        } else {
+            close(fds[0]);
+        }
+
+        if (stage.out != NULL) {
+            fclose(stage.out);
+        } else {
+            close(fds[1]);
+        }
+
+        return false;
+    }
+
+    bool encrypted = true;
+
+    if (pool->codec != CODEC_NONE) {
+        encrypted = ss_encrypt_file_compressed(plain_in, outfile, pool->n, pool->codec);
+    } else {
+        ss_encrypt_file(plain_in, outfile, pool->n);
+    }
+
+    encrypted = encrypted && ferror(plain_in) == 0 && fflush(outfile) == 0 && ferror(outfile) == 0;
+
+    // CLOSE the read end before joining, so a decrypting side still writing gets EPIPE.
+    fclose(plain_in);
+    pthread_join(thread, NULL);
+
+    return encrypted && stage.ok;
+}
+
+// RUNS one task, streaming whole files straight to their output.
+static void run_task(Pool *pool, Task *task) {
+    Job *job = task->job;
+    FILE *infile = fopen(job->in_name, "r");
+    bool whole = job->num_ranges == 1;
+
+    char *output = NULL;
+    size_t output_len = 0;
+    FILE *outfile = NULL;
+
+    if (whole) {
+        pthread_mutex_lock(&job->lock);
+        job_open(job);
+        outfile = job->out;
+        pthread_mutex_unlock(&job->lock);
+    } else {
+        outfile = open_memstream(&output, &output_len);
+    }
+
+    if (infile == NULL || outfile == NULL
+        || (!whole && fseeko(infile, task->offset, SEEK_SET) != 0)) {
+        pthread_mutex_lock(&job->lock);
+        job->failed = true;
+        pthread_mutex_unlock(&job->lock);
+    } else {
+        FILE *range_in = whole ? infile : shard_reader(infile, task->length);
+        bool ok = true;
+
+        if (pool->mode == MODE_REENCRYPT) {
+            ok = reencrypt(pool, range_in, outfile);
+        } else if (pool->mode == MODE_DECRYPT) {
+            ok = ss_decrypt_file(range_in, outfile, pool->d, pool->pq);
+        } else if (pool->codec != CODEC_NONE) {
+            ok = ss_encrypt_file_compressed(range_in, outfile, pool->n, pool->codec);
+        } else {
+            ss_encrypt_file(range_in, outfile, pool->n);
+        }
+
+        if (!ok) {
+            pthread_mutex_lock(&job->lock);
+            job->failed = true;
+            pthread_mutex_unlock(&job->lock);
+        }
+
+        if (range_in != infile) {
+            fclose(range_in);
+        }
+    }
+
+    if (!whole && outfile != NULL) {
+        fclose(outfile);
+    }
+
+    if (infile != NULL) {
+        fclose(infile);
+    }
+
+    // HAND the output over and FLUSH whatever is now next in line.
+    pthread_mutex_lock(&job->lock);
+    job->outputs[task->range] = output;
+    job->output_lens[task->range] = output_len;
+    job->done[task->range] = true;
+    job_flush(job);
+    pthread_mutex_unlock(&job->lock);
+}
+
+// WORKS through the worker's own deque, then STEALS from the others until all are empty.
+static void *work(void *arg) {
+    Worker *w = (Worker *) arg;
+    Pool *pool = w->pool;
+
+    while (true) {
+        Task *task = deque_take(&pool->deques[w->self]);
+
+        for (uint64_t i = 1; task == NULL && i < pool->threads; i += 1) {
+            task = deque_take(&pool->deques[(w->self + i) % pool->threads]);
+        }
+
+        // Tasks never create tasks, so a full pass over empty deques means the batch is done.
+        if (task == NULL) {
+            break;
+        }
+
+        run_task(pool, task);
+    }
+
+    return NULL;
+}
+
+// FINDS the offset just past the first newline at or after 'offset', or the file size.
+static uint64_t next_line(FILE *infile, uint64_t offset, uint64_t size) {
+    if (offset == 0 || offset >= size || fseeko(infile, offset - 1, SEEK_SET) != 0) {
+        return offset >= size ? size : offset;
+    }
+
+    int c;
+
+    while ((c = fgetc(infile)) != EOF && c != '\n') {
+        offset += 1;
+    }
+
+    return c == EOF ? size : offset;
+}
+
+// PLANS the ranges of a job, appending one task per range to 'tasks'.
+static bool plan_job(Pool *pool, Job *job, uint64_t block, Task **tasks, size_t *num_tasks,
+    size_t *capacity) {
+    FILE *infile = fopen(job->in_name, "r");
+    struct stat st;
+
+    if (infile == NULL || fstat(fileno(infile), &st) != 0) {
+        if (infile != NULL) {
+            fclose(infile);
+        }
+        return false;
+    }
+
+    uint64_t size = S_ISREG(st.st_mode) ? (uint64_t) st.st_size : 0;
+
+    // SPLIT plaintext on whole blocks, and ciphertext on lines, unless it is compressed.
+    bool splittable = S_ISREG(st.st_mode) && pool->codec == CODEC_NONE;
+
+    if (pool->mode != MODE_ENCRYPT) {
+        splittable = splittable && fgetc(infile) != '#';
+    }
+
+    uint64_t step = (pool->mode != MODE_ENCRYPT) ? RANGE_BYTES : (RANGE_BYTES / block) * block;
+    step = (step == 0) ? block : step;
+
+    uint64_t *bounds = (uint64_t *) malloc((size / step + 2) * sizeof(uint64_t));
+    uint64_t num_ranges = 0;
+
+    bounds[num_ranges++] = 0;
+
+    for (uint64_t at = step; splittable && at < size; at += step) {
+        uint64_t bound = (pool->mode != MODE_ENCRYPT) ? next_line(infile, at, size) : at;
+
+        if (bound > bounds[num_ranges - 1] && bound < size) {
+            bounds[num_ranges++] = bound;
+        }
+    }
+
+    bounds[num_ranges] = splittable ? size : 0;
+    fclose(infile);
+
+    job->num_ranges = num_ranges;
+    job->outputs = (char **) calloc(num_ranges, sizeof(char *));
+    job->output_lens = (size_t *) calloc(num_ranges, sizeof(size_t));
+    job->done = (bool *) calloc(num_ranges, sizeof(bool));
+
+    for (uint64_t r = 0; r < num_ranges; r += 1) {
+        if (*num_tasks == *capacity) {
+            *capacity *= 2;
+            *tasks = (Task *) realloc(*tasks, *capacity * sizeof(Task));
+        }
+
+        Task *task = &(*tasks)[(*num_tasks)++];
+        task->job = job;
+        task->range = r;
+        task->offset = bounds[r];
+        task->length = bounds[r + 1] - bounds[r];
+    }
+
+    free(bounds);
+
+    return true;
+}
+
+// READS the jobs of a batch manifest into 'jobs', or a single job if 'batch_file' is NULL.
+static bool read_jobs(const char *batch_file, const char *in_name, const char *out_name,
+    Job **jobs_out, size_t *num_jobs_out) {
+    size_t num_jobs = 0;
+    size_t job_capacity = 16;
+    Job *jobs = (Job *) calloc(job_capacity, sizeof(Job));
+
+    if (batch_file == NULL) {
+        jobs[0].in_name = strdup(in_name);
+        jobs[0].out_name = strdup(out_name);
+
+        *jobs_out = jobs;
+        *num_jobs_out = 1;
+
+        return true;
+    }
+
+    FILE *bfile = fopen(batch_file, "r");
+
+    if (bfile == NULL) {
+        fprintf(stderr, "Error: Could not access batch file.\n");
+        free(jobs);
+        return false;
+    }
+
+    char *line = NULL;
+    size_t line_capacity = 0;
+
+    while (getline(&line, &line_capacity, bfile) != -1) {
+        char in_name[4096];
+        char out_name[4096];
+
+        if (line[0] == '#' || sscanf(line, "%4095s %4095s", in_name, out_name) != 2) {
+            continue;
+        }
+
+        if (num_jobs == job_capacity) {
+            job_capacity *= 2;
+            jobs = (Job *) realloc(jobs, job_capacity * sizeof(Job));
+        }
+
+        memset(&jobs[num_jobs], 0, sizeof(Job));
+        jobs[num_jobs].in_name = strdup(in_name);
+        jobs[num_jobs].out_name = strdup(out_name);
+        num_jobs += 1;
+    }
+
+    free(line);
+    fclose(bfile);
+
+    *jobs_out = jobs;
+    *num_jobs_out = num_jobs;
+
+    return true;
+}
+
+// READS the jobs, PLANS every one of them and RUNS the pool.
+static bool batch_run(const char *batch_file, const char *in_name, const char *out_name, Pool *pool,
+    uint64_t block) {
+    Job *jobs;
+    size_t num_jobs;
+
+    if (!read_jobs(batch_file, in_name, out_name, &jobs, &num_jobs)) {
+        return false;
+    }
+
+    // PLAN the tasks of every job. Outputs are opened as their jobs run.
+    size_t num_tasks = 0;
+    size_t task_capacity = 16;
+    Task *tasks = (Task *) malloc(task_capacity * sizeof(Task));
+    bool ok = true;
+
+    for (size_t j = 0; j < num_jobs; j += 1) {
+        Job *job = &jobs[j];
+
+        pthread_mutex_init(&job->lock, NULL);
+
+        if (!plan_job(pool, job, block, &tasks, &num_tasks, &task_capacity)) {
+            fprintf(stderr, "Error: Could not access %s.\n", job->in_name);
+            job->failed = true;
+            job->num_ranges = 0;
+            ok = false;
+        }
+    }
+
+    // DEAL the tasks round-robin, skipping jobs that could not be planned.
+    pool->deques = (Deque *) calloc(pool->threads, sizeof(Deque));
+
+    for (uint64_t t = 0; t < pool->threads; t += 1) {
+        pool->deques[t].tasks = (Task **) malloc((num_tasks / pool->threads + 1) * sizeof(Task *));
+        pthread_mutex_init(&pool->deques[t].lock, NULL);
+    }
+
+    for (size_t i = 0, t = 0; i < num_tasks; i += 1) {
+        if (tasks[i].job->num_ranges > 0) {
+            Deque *q = &pool->deques[t];
+            q->tasks[q->tail++] = &tasks[i];
+            t = (t + 1) % pool->threads;
+        }
+    }
+
+    // RUN the pool.
+    pthread_t *threads = (pthread_t *) malloc(pool->threads * sizeof(pthread_t));
+    Worker *workers = (Worker *) malloc(pool->threads * sizeof(Worker));
+
+    for (uint64_t t = 0; t < pool->threads; t += 1) {
+        workers[t] = (Worker) { pool, t };
+        pthread_create(&threads[t], NULL, work, &workers[t]);
+    }
+
+    for (uint64_t t = 0; t < pool->threads; t += 1) {
+        pthread_join(threads[t], NULL);
+    }
+
+    // REPORT failures and DEALLOCATE everything.
+    for (size_t j = 0; j < num_jobs; j += 1) {
+        Job *job = &jobs[j];
+
+        if (job->failed && job->num_ranges > 0) {
+            fprintf(stderr, "Error: Could not process %s.\n", job->in_name);
+            ok = false;
+        }
+
+        if (job->out != NULL) {
+            fclose(job->out);
+        }
+
+        pthread_mutex_destroy(&job->lock);
+        free(job->in_name);
+        free(job->out_name);
+        free(job->outputs);
+        free(job->output_lens);
+        free(job->done);
+    }
+
+    for (uint64_t t = 0; t < pool->threads; t += 1) {
+        pthread_mutex_destroy(&pool->deques[t].lock);
+        free(pool->deques[t].tasks);
+    }
+
+    free(pool->deques);
+    free(threads);
+    free(workers);
+    free(tasks);
+    free(jobs);
+
+    return ok;
+}
+
+bool batch_encrypt(const char *batch_file, const mpz_t n, Codec codec, uint64_t threads) {
+    Pool pool = { .threads = threads, .mode = MODE_ENCRYPT, .codec = codec, .n = n };
+
+    return batch_run(batch_file, NULL, NULL, &pool, ss_block_size(n) - 1);
+}
+
+bool batch_decrypt(const char *batch_file, const mpz_t d, const mpz_t pq, uint64_t threads) {
+    Pool pool = { .threads = threads, .mode = MODE_DECRYPT, .codec = CODEC_NONE, .d = d, .pq = pq };
+
+    return batch_run(batch_file, NULL, NULL, &pool, 1);
+}
+
+bool batch_reencrypt(const char *batch_file, const char *in_name, const char *out_name,
+    const mpz_t d, const mpz_t pq, const mpz_t n, Codec codec, uint64_t threads) {
+    Pool pool = {
+        .threads = threads, .mode = MODE_REENCRYPT, .codec = codec, .n = n, .d = d, .pq = pq
+    };
+
+    return batch_run(batch_file, in_name, out_name, &pool, 1);
+}
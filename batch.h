@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "compress.h"
+
+//
+// Encrypt every file listed in a batch manifest on a work-stealing thread pool.
+// Each line of the manifest names an input file and an output file; blank
+// lines and lines starting with '#' are skipped. Large inputs are split into
+// block-aligned ranges that run in parallel and are written out in order.
+//
+// Requires:
+//  batch_file: path of the batch manifest
+//  n: public exponent and modulus
+//  codec: CODEC_NONE, or a codec to compress each whole file with
+//  threads: # of worker threads, at least 1
+//
+// Returns false if any job failed.
+//
+bool batch_encrypt(const char *batch_file, const mpz_t n, Codec codec, uint64_t threads);
+
+//
+// Decrypt every file listed in a batch manifest on a work-stealing thread pool.
+// Large ciphertexts are split on block (line) boundaries, except compressed
+// ones, which are decrypted whole.
+//
+// Requires:
+//  batch_file: path of the batch manifest
+//  d: private exponent
+//  pq: private modulus
+//  threads: # of worker threads, at least 1
+//
+// Returns false if any job failed.
+//
+bool batch_decrypt(const char *batch_file, const mpz_t d, const mpz_t pq, uint64_t threads);
+
+//
+// Re-encrypt ciphertext under a new public key on a work-stealing thread pool,
+// for every file listed in a batch manifest or for one input and output file.
+// Each range is decrypted on one thread and piped straight into encryption
+// on another, so plaintext never reaches disk. Ciphertext is split on lines
+// like batch_decrypt splits it, unless it or the output is compressed.
+// SIGPIPE must be ignored, so a failed stage fails its job instead of the process.
+//
+// Requires:
+//  batch_file: path of the batch manifest, or NULL to use in_name and out_name
+//  in_name: path of the ciphertext to re-encrypt, if batch_file is NULL
+//  out_name: path of the new ciphertext, if batch_file is NULL
+//  d: old private exponent
+//  pq: old private modulus
+//  n: new public exponent and modulus
+//  codec: CODEC_NONE, or a codec to compress each whole file with before encrypting
+//  threads: # of worker threads, at least 1
+//
+// Returns false if any job failed.
+//
+bool batch_reencrypt(const char *batch_file, const char *in_name, const char *out_name,
+    const mpz_t d, const mpz_t pq, const mpz_t n, Codec codec, uint64_t threads);
@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "compress.h"
+
+// The in-tree codec compresses independent chunks of up to LZ_CHUNK bytes.
+// Each chunk is stored as its raw length and encoded length (4 bytes each,
+// little-endian) followed by LZ4-style sequences: a token byte holding the
+// literal count and match length - 4, the literals, then a 2-byte offset.
+// The last sequence of a chunk has literals only.
+#define LZ_CHUNK   (1 << 16)
+#define LZ_BOUND   (LZ_CHUNK + (LZ_CHUNK / 255) + 64)
+#define LZ_HASH    12
+#define LZ_MIN     4
+#define ZLIB_CHUNK (1 << 16)
+
+typedef struct {
+    FILE *file;
+    Codec codec;
+    bool eof;
+    uint8_t *raw;
+    uint8_t *enc;
+    size_t pos;
+    size_t len;
+#ifdef HAVE_ZLIB
+    z_stream strm;
+#endif
+} Stream;
+
+Codec compress_best_codec(void) {
+#ifdef HAVE_ZLIB
+    return CODEC_ZLIB;
+#else
+    return CODEC_LZ;
+#endif
+}
+
+const char *compress_codec_name(Codec codec) {
+    switch (codec) {
+    case CODEC_LZ: return "lz";
+    case CODEC_ZLIB: return "zlib";
+    default: return "none";
+    }
+}
+
+Codec compress_codec_from_name(const char *name) {
+    if (strcmp(name, "lz") == 0) {
+        return CODEC_LZ;
+    }
+
+#ifdef HAVE_ZLIB
+    if (strcmp(name, "zlib") == 0) {
+        return CODEC_ZLIB;
+    }
+#endif
+
+    return CODEC_NONE;
+}
+
+// WRITES 'v' as 4 little-endian bytes.
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+// READS 4 little-endian bytes.
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+// WRITES a length of 15 or more as a run of 255s ended by a smaller byte.
+static uint8_t *put_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+
+    return op;
+}
+
+// ENCODES 'n' bytes of 'src' into 'dst', returning the encoded length.
+static size_t lz_encode(uint8_t *dst, const uint8_t *src, size_t n) {
+    uint32_t table[1 << LZ_HASH];
+    uint8_t *op = dst;
+    size_t anchor = 0;
+    size_t i = 0;
+
+    memset(table, 0xFF, sizeof(table));
+
+    while (i + LZ_MIN <= n) {
+        uint32_t seq = get_u32(src + i);
+        uint32_t h = (seq * 2654435761u) >> (32 - LZ_HASH);
+        uint32_t cand = table[h];
+
+        table[h] = i;
+
+        if (cand == UINT32_MAX || i - cand > 0xFFFF || get_u32(src + cand) != seq) {
+            i += 1;
+            continue;
+        }
+
+        // EXTEND the match as far as it goes.
+        size_t match = LZ_MIN;
+        while (i + match < n && src[cand + match] == src[i + match]) {
+            match += 1;
+        }
+
+        // EMIT literals since the last match, then the match itself.
+        size_t lits = i - anchor;
+        uint8_t *token = op++;
+        *token = ((lits < 15 ? lits : 15) << 4) | (match - LZ_MIN < 15 ? match - LZ_MIN : 15);
+
+        if (lits >= 15) {
+            op = put_length(op, lits - 15);
+        }
+
+        memcpy(op, src + anchor, lits);
+        op += lits;
+
+        *op++ = (i - cand) & 0xFF;
+        *op++ = (i - cand) >> 8;
+
+        if (match - LZ_MIN >= 15) {
+            op = put_length(op, match - LZ_MIN - 15);
+        }
+
+        i += match;
+        anchor = i;
+    }
+
+    // EMIT the trailing literals as the last sequence.
+    size_t lits = n - anchor;
+    *op++ = (lits < 15 ? lits : 15) << 4;
+
+    if (lits >= 15) {
+        op = put_length(op, lits - 15);
+    }
+
+    memcpy(op, src + anchor, lits);
+    op += lits;
+
+    return op - dst;
+}
+
+// READS a length extension, returning false if it runs past 'end'.
+static bool get_length(const uint8_t **ip, const uint8_t *end, size_t *len) {
+    uint8_t b = 255;
+
+    while (b == 255) {
+        if (*ip >= end) {
+            return false;
+        }
+        b = *(*ip)++;
+        *len += b;
+    }
+
+    return true;
+}
+
+// DECODES 'n' encoded bytes of 'src' into exactly 'raw_len' bytes of 'dst'.
+static bool lz_decode(uint8_t *dst, size_t raw_len, const uint8_t *src, size_t n) {
+    const uint8_t *ip = src;
+    const uint8_t *end = src + n;
+    size_t o = 0;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lits = token >> 4;
+
+        if (lits == 15 && !get_length(&ip, end, &lits)) {
+            return false;
+        }
+
+        if (lits > (size_t) (end - ip) || lits > raw_len - o) {
+            return false;
+        }
+
+        memcpy(dst + o, ip, lits);
+        ip += lits;
+        o += lits;
+
+        // CHECK for the literal-only last sequence.
+        if (ip == end) {
+            break;
+        }
+
+        if (end - ip < 2) {
+            return false;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        size_t match = (token & 0x0F) + LZ_MIN;
+        ip += 2;
+
+        if (match == 15 + LZ_MIN && !get_length(&ip, end, &match)) {
+            return false;
+        }
+
+        if (offset == 0 || offset > o || match > raw_len - o) {
+            return false;
+        }
+
+        // COPY byte by byte, since the match may overlap its own output.
+        for (size_t j = 0; j < match; j += 1) {
+            dst[o + j] = dst[o + j - offset];
+        }
+        o += match;
+    }
+
+    return o == raw_len;
+}
+
+// FILLS the next compressed chunk of an LZ read stream.
+static void lz_fill(Stream *s) {
+    size_t raw_len = 0;
+
+    while (raw_len < LZ_CHUNK && feof(s->file) == 0 && ferror(s->file) == 0) {
+        raw_len += fread(s->raw + raw_len, sizeof(uint8_t), LZ_CHUNK - raw_len, s->file);
+    }
+
+    s->pos = 0;
+    s->len = 0;
+
+    if (raw_len == 0) {
+        s->eof = true;
+        return;
+    }
+
+    size_t enc_len = lz_encode(s->enc + 8, s->raw, raw_len);
+    put_u32(s->enc, raw_len);
+    put_u32(s->enc + 4, enc_len);
+    s->len = enc_len + 8;
+}
+
+// DECODES and WRITES every complete chunk buffered in an LZ write stream.
+static bool lz_drain(Stream *s) {
+    while (s->len >= 8) {
+        size_t raw_len = get_u32(s->enc);
+        size_t enc_len = get_u32(s->enc + 4);
+
+        if (raw_len > LZ_CHUNK || enc_len > LZ_BOUND - 8) {
+            return false;
+        }
+
+        if (s->len < enc_len + 8) {
+            break;
+        }
+
+        if (!lz_decode(s->raw, raw_len, s->enc + 8, enc_len)) {
+            return false;
+        }
+
+        fwrite(s->raw, sizeof(uint8_t), raw_len, s->file);
+
+        memmove(s->enc, s->enc + enc_len + 8, s->len - enc_len - 8);
+        s->len -= enc_len + 8;
+    }
+
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+// FILLS the next run of deflated bytes of a zlib read stream.
+static void zlib_fill(Stream *s) {
+    s->strm.next_out = s->enc;
+    s->strm.avail_out = ZLIB_CHUNK;
+
+    while (s->strm.avail_out == ZLIB_CHUNK && !s->eof) {
+        if (s->strm.avail_in == 0 && feof(s->file) == 0) {
+            s->strm.next_in = s->raw;
+            s->strm.avail_in = fread(s->raw, sizeof(uint8_t), ZLIB_CHUNK, s->file);
+        }
+
+        bool last = feof(s->file) != 0 || ferror(s->file) != 0;
+
+        if (deflate(&s->strm, last ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_END) {
+            s->eof = true;
+        }
+    }
+
+    s->pos = 0;
+    s->len = ZLIB_CHUNK - s->strm.avail_out;
+}
+
+// INFLATES 'size' bytes of 'buf' and WRITES the output of a zlib write stream.
+static bool zlib_drain(Stream *s, const uint8_t *buf, size_t size) {
+    s->strm.next_in = (uint8_t *) buf;
+    s->strm.avail_in = size;
+
+    while (s->strm.avail_in > 0 && !s->eof) {
+        s->strm.next_out = s->raw;
+        s->strm.avail_out = ZLIB_CHUNK;
+
+        int ret = inflate(&s->strm, Z_NO_FLUSH);
+
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            return false;
+        }
+
+        fwrite(s->raw, sizeof(uint8_t), ZLIB_CHUNK - s->strm.avail_out, s->file);
+        s->eof = ret == Z_STREAM_END;
+    }
+
+    return true;
+}
+#endif
+
+static ssize_t reader_read(void *cookie, char *buf, size_t size) {
+    Stream *s = (Stream *) cookie;
+    size_t copied = 0;
+
+    while (copied < size) {
+        if (s->pos == s->len) {
+            if (s->eof) {
+                break;
+            }
+
+#ifdef HAVE_ZLIB
+            if (s->codec == CODEC_ZLIB) {
+                zlib_fill(s);
+            } else
+#endif
+                lz_fill(s);
+
+            continue;
+        }
+
+        size_t n = s->len - s->pos < size - copied ? s->len - s->pos : size - copied;
+        memcpy(buf + copied, s->enc + s->pos, n);
+        s->pos += n;
+        copied += n;
+    }
+
+    return copied;
+}
+
+static ssize_t writer_write(void *cookie, const char *buf, size_t size) {
+    Stream *s = (Stream *) cookie;
+
+#ifdef HAVE_ZLIB
+    if (s->codec == CODEC_ZLIB) {
+        if (!zlib_drain(s, (const uint8_t *) buf, size)) {
+            fprintf(stderr, "Error: Corrupt compressed data.\n");
+            return -1;
+        }
+
+        return size;
+    }
+#endif
+
+    size_t written = 0;
+
+    while (written < size) {
+        size_t n = LZ_BOUND - s->len < size - written ? LZ_BOUND - s->len : size - written;
+        memcpy(s->enc + s->len, buf + written, n);
+        s->len += n;
+        written += n;
+
+        if (!lz_drain(s)) {
+            fprintf(stderr, "Error: Corrupt compressed data.\n");
+            return -1;
+        }
+    }
+
+    return size;
+}
+
+static int reader_close(void *cookie) {
+    Stream *s = (Stream *) cookie;
+
+#ifdef HAVE_ZLIB
+    if (s->codec == CODEC_ZLIB) {
+        deflateEnd(&s->strm);
+    }
+#endif
+
+    free(s->raw);
+    free(s->enc);
+    free(s);
+
+    return 0;
+}
+
+static int writer_close(void *cookie) {
+    Stream *s = (Stream *) cookie;
+
+    // CHECK that no partial chunk or unfinished zlib stream is left over.
+    bool complete = s->len == 0;
+
+#ifdef HAVE_ZLIB
+    if (s->codec == CODEC_ZLIB) {
+        complete = s->eof;
+        inflateEnd(&s->strm);
+    }
+#endif
+
+    if (!complete) {
+        fprintf(stderr, "Error: Truncated compressed data.\n");
+    }
+
+    free(s->raw);
+    free(s->enc);
+    free(s);
+
+    return complete ? 0 : -1;
+}
+
+// ALLOCATES the state shared by read and write streams.
+static Stream *stream_create(FILE *file, Codec codec) {
+    Stream *s = (Stream *) calloc(1, sizeof(Stream));
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->file = file;
+    s->codec = codec;
+    s->raw = (uint8_t *) malloc(LZ_CHUNK > ZLIB_CHUNK ? LZ_CHUNK : ZLIB_CHUNK);
+    s->enc = (uint8_t *) malloc(LZ_BOUND > ZLIB_CHUNK ? LZ_BOUND : ZLIB_CHUNK);
+
+    if (s->raw == NULL || s->enc == NULL) {
+        free(s->raw);
+        free(s->enc);
+        free(s);
+        return NULL;
+    }
+
+    return s;
+}
+
+FILE *compress_reader(FILE *infile, Codec codec) {
+    Stream *s = stream_create(infile, codec);
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+#ifdef HAVE_ZLIB
+    if (codec == CODEC_ZLIB && deflateInit(&s->strm, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        reader_close(s);
+        return NULL;
+    }
+#endif
+
+    cookie_io_functions_t io = { .read = reader_read, .close = reader_close };
+
+    return fopencookie(s, "r", io);
+}
+
+FILE *decompress_writer(FILE *outfile, Codec codec) {
+    Stream *s = stream_create(outfile, codec);
+
+    if (s == NULL) {
+        return NULL;
+    }
+
+#ifdef HAVE_ZLIB
+    if (codec == CODEC_ZLIB && inflateInit(&s->strm) != Z_OK) {
+        free(s->raw);
+        free(s->enc);
+        free(s);
+        return NULL;
+    }
+#endif
+
+    cookie_io_functions_t io = { .write = writer_write, .close = writer_close };
+
+    return fopencookie(s, "w", io);
+}
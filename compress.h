@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Compression codecs that can run in front of SS block encryption.
+// CODEC_LZ is built in; CODEC_ZLIB needs zlib at build time.
+//
+typedef enum { CODEC_NONE, CODEC_LZ, CODEC_ZLIB } Codec;
+
+//
+// Returns the best codec available in this build.
+//
+Codec compress_best_codec(void);
+
+//
+// Returns the name of a codec as written in ciphertext headers.
+//
+const char *compress_codec_name(Codec codec);
+
+//
+// Looks up a codec by its ciphertext header name.
+//
+// Returns CODEC_NONE if the name is unknown or the codec is not built in.
+//
+Codec compress_codec_from_name(const char *name);
+
+//
+// Wraps a plaintext stream in a read stream of its compressed bytes.
+//
+// Requires:
+//  infile: open and readable file stream (left open on close)
+//  codec: CODEC_LZ or CODEC_ZLIB
+//
+// Returns NULL on failure.
+//
+FILE *compress_reader(FILE *infile, Codec codec);
+
+//
+// Wraps a plaintext stream in a write stream that decompresses what is written to it.
+// Closing the returned stream flushes the remaining plaintext to outfile.
+//
+// Requires:
+//  outfile: open and writable file stream (left open on close)
+//  codec: CODEC_LZ or CODEC_ZLIB
+//
+// Returns NULL on failure.
+//
+FILE *decompress_writer(FILE *outfile, Codec codec);
@@ -5,11 +5,35 @@
 #include <getopt.h>
 #include <gmp.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "ss.h"
+#include "shard.h"
+#include "batch.h"
+#include "stats.h"
+#include "aio.h"
 #include "randstate.h"
 
-#define OPTIONS "i:o:n:vh"
+#define OPTIONS "i:o:n:t:xI:B:vh"
+
+// DECRYPTS 'infile' into 'outfile', OVERLAPPING reads and writes with the block loop.
+static bool decrypt_stream(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq) {
+    FILE *async_in = aio_reader(infile);
+    FILE *async_out = aio_writer(outfile);
+
+    bool decrypted = ss_decrypt_file(async_in, async_out, d, pq);
+
+    if (async_in != infile) {
+        fclose(async_in);
+    }
+
+    if (async_out != outfile && fclose(async_out) != 0) {
+        return false;
+    }
+
+    return fflush(outfile) == 0 && decrypted;
+}
 
 int main(int argc, char **argv) {
 
@@ -17,11 +41,16 @@ int main(int argc, char **argv) {
 
     bool toggle_i = false;
     bool toggle_o = false;
+    bool toggle_x = false;
     bool verbose_output = false;
 
+    int64_t shard_index = -1;
+    char *batch_name = NULL;
+
     char *priv_file = "ss.priv";
     char *in_name = "default_input";
     char *out_name = "default_output";
+    char *stats_name = NULL;
 
     mpz_t pq, d;
 
@@ -40,6 +69,22 @@ int main(int argc, char **argv) {
         case 'n': // SPECIFY private key file.
             priv_file = optarg;
 
+            break;
+        case 't': // SPECIFY per-block statistics file.
+            stats_name = optarg;
+
+            break;
+        case 'x': // READ input as a shard manifest.
+            toggle_x = true;
+
+            break;
+        case 'I': // SPECIFY the one shard to decrypt.
+            shard_index = strtol(optarg, NULL, 10);
+
+            break;
+        case 'B': // SPECIFY batch manifest of input and output files.
+            batch_name = optarg;
+
             break;
         case 'v': // ENABLE verbose output.
             verbose_output = true;
@@ -57,11 +102,23 @@ int main(int argc, char **argv) {
             printf("   -i infile       Input file of data to decrypt (default: stdin).\n");
             printf("   -o outfile      Output file for decrypted data (default: stdout).\n");
             printf("   -n pvfile       Private key file (default: ss.priv).\n");
+            printf("   -t statsfile    Write per-block latency statistics as JSON at exit.\n");
+            printf("   -x              Input file is a shard manifest written by encrypt -x;\n");
+            printf("                   decrypt and reassemble all of its shards in order.\n");
+            printf("   -I index        With -x, only decrypt shard index, writing it in place\n");
+            printf("                   in outfile (needs -o; run one process per shard).\n");
+            printf("   -B batchfile    Decrypt every \"infile outfile\" line of batchfile on all\n");
+            printf("                   cores, loading the key once.\n");
 
             break;
         }
     }
 
+    if (toggle_x && (!toggle_i || (shard_index >= 0 && !toggle_o))) {
+        fprintf(stderr, "Error: Decrypt needs -i for -x, and -o for -I.\n");
+        return 1;
+    }
+
     // OPEN the private key file.
 
     FILE *pvfile = fopen(priv_file, "r");
@@ -86,7 +143,15 @@ int main(int argc, char **argv) {
         input_file = stdin;
     }
 
-    if (toggle_o) {
+    if (toggle_o && shard_index >= 0) {
+        // OPEN without truncating, since other processes write the other shards.
+        int fd = open(out_name, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        output_file = (fd < 0) ? NULL : fdopen(fd, "w");
+        if (output_file == NULL) {
+            fprintf(stderr, "Error: Decrypt could not access output file.\n");
+            return 1;
+        }
+    } else if (toggle_o) {
         output_file = fopen(out_name, "w");
         if (output_file == NULL) {
             fprintf(stderr, "Error: Decrypt could not access output file.\n");
@@ -96,6 +161,20 @@ int main(int argc, char **argv) {
         output_file = stdout;
     }
 
+    // ENABLE per-block statistics if a statistics file was given.
+
+    FILE *stats_file = NULL;
+
+    if (stats_name != NULL) {
+        stats_file = fopen(stats_name, "w");
+        if (stats_file == NULL) {
+            fprintf(stderr, "Error: Decrypt could not access statistics file.\n");
+            return 1;
+        }
+
+        stats_init();
+    }
+
     // INITIALIZE multiple-precision variables.
 
     mpz_inits(pq, d, NULL);
@@ -111,9 +190,68 @@ int main(int argc, char **argv) {
         gmp_fprintf(stdout, "d (%d bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
     }
 
-    // DECRYPT file.
+    // DECRYPT file, every requested shard of a manifest, or every file of a batch.
 
-    ss_decrypt_file(input_file, output_file, d, pq);
+    bool decrypted = true;
+
+    if (batch_name != NULL) {
+        uint64_t num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+        if (!batch_decrypt(batch_name, d, pq, num_threads ? num_threads : 1)) {
+            return 1;
+        }
+    } else if (toggle_x) {
+        Manifest m;
+
+        if (!shard_read_manifest(&m, in_name)) {
+            fprintf(stderr, "Error: Decrypt could not read shard manifest.\n");
+            return 1;
+        }
+
+        if (shard_index >= (int64_t) m.count) {
+            fprintf(stderr, "Error: Decrypt shard index is out of range.\n");
+            return 1;
+        }
+
+        // SIZE the output up front, so in-place shards never leave stale bytes after the end.
+        if (shard_index >= 0 && ftruncate(fileno(output_file), m.size) != 0) {
+            fprintf(stderr, "Error: Decrypt could not size output file.\n");
+            return 1;
+        }
+
+        for (uint64_t i = 0; i < m.count && decrypted; i += 1) {
+            if (shard_index >= 0 && i != (uint64_t) shard_index) {
+                continue;
+            }
+
+            char *path = shard_path(in_name, &m.shards[i]);
+            FILE *shard_file = fopen(path, "r");
+
+            free(path);
+
+            if (shard_file == NULL) {
+                fprintf(stderr, "Error: Decrypt could not access shard %lu.\n", i);
+                return 1;
+            }
+
+            if (shard_index >= 0) {
+                fseeko(output_file, m.shards[i].offset, SEEK_SET);
+            }
+
+            decrypted = decrypt_stream(shard_file, output_file, d, pq);
+
+            fclose(shard_file);
+        }
+
+        shard_clear(&m);
+    } else {
+        decrypted = decrypt_stream(input_file, output_file, d, pq);
+    }
+
+    if (!decrypted) {
+        fprintf(stderr, "Error: Decrypt could not decrypt input or write output file.\n");
+        return 1;
+    }
 
     // CLOSE public key file and CLEAR variables.
 
@@ -121,5 +259,12 @@ int main(int argc, char **argv) {
 
     mpz_clears(pq, d, NULL);
 
+    // WRITE per-block statistics.
+
+    if (stats_file != NULL) {
+        stats_dump("decrypt", stats_file);
+        fclose(stats_file);
+    }
+
     return 0;
 }
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdbool.h>
 #include <stdlib.h>
 #include <sys/stat.h>
@@ -5,11 +7,304 @@
 #include <getopt.h>
 #include <gmp.h>
 #include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "ss.h"
+#include "shard.h"
+#include "ring.h"
+#include "batch.h"
+#include "stats.h"
+#include "aio.h"
 #include "randstate.h"
 
-#define OPTIONS "i:o:n:vh"
+#define OPTIONS "i:o:n:u:F:K:a:zt:x:I:B:vh"
+
+// A public key named on the command line: a public key file (-n), or a keyring
+// user (-u) or key fingerprint (-F).
+typedef struct {
+    int kind;
+    char *name;
+} KeySource;
+
+// A public key that the shared input is encrypted to.
+typedef struct {
+    mpz_t n;
+    char username[LOGIN_NAME_MAX];
+    FILE *output_file;
+} Recipient;
+
+// Bytes of input the fan-out holds at once, however large the input is.
+#define FAN_OUT_BYTES (1 << 20)
+
+// State shared by the fan-out encryption threads, one per recipient. Every thread reads the
+// same chunk of input, and the last to finish it refills the chunk for all of them.
+typedef struct {
+    FILE *input;
+    uint8_t *chunk;
+    size_t len;
+    uint64_t generation;
+    size_t readers;
+    size_t waiting;
+    bool eof;
+    bool read_failed;
+    Recipient *recipients;
+    size_t num_recipients;
+    Codec codec;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t refilled;
+} FanOut;
+
+// A recipient thread's read position in the shared chunk.
+typedef struct {
+    FanOut *fan;
+    uint64_t generation;
+    size_t pos;
+} FanReader;
+
+typedef struct {
+    FanOut *fan;
+    size_t index;
+} FanWorker;
+
+// REFILLS the shared chunk and WAKES every reader waiting for it. Requires the fan-out lock.
+static void fan_out_refill(FanOut *fan) {
+    fan->len = fread(fan->chunk, sizeof(uint8_t), FAN_OUT_BYTES, fan->input);
+    fan->read_failed = fan->read_failed || ferror(fan->input) != 0;
+    fan->eof = fan->len < FAN_OUT_BYTES;
+    fan->generation += 1;
+    fan->waiting = 0;
+
+    pthread_cond_broadcast(&fan->refilled);
+}
+
+// READS from the shared chunk, WAITING for the other readers to finish it before the refill.
+static ssize_t fan_out_read(void *cookie, char *buf, size_t size) {
+    FanReader *r = (FanReader *) cookie;
+    FanOut *fan = r->fan;
+
+    pthread_mutex_lock(&fan->lock);
+
+    while (r->pos == fan->len && !(fan->eof && r->generation == fan->generation)) {
+        if (++fan->waiting == fan->readers) {
+            fan_out_refill(fan);
+        } else {
+            for (uint64_t g = fan->generation; g == fan->generation;) {
+                pthread_cond_wait(&fan->refilled, &fan->lock);
+            }
+        }
+
+        r->generation = fan->generation;
+        r->pos = 0;
+    }
+
+    size_t n = fan->len - r->pos;
+    n = (n < size) ? n : size;
+
+    memcpy(buf, fan->chunk + r->pos, n);
+    r->pos += n;
+
+    bool failed = fan->read_failed;
+
+    pthread_mutex_unlock(&fan->lock);
+
+    return (failed && n == 0) ? -1 : (ssize_t) n;
+}
+
+// LEAVES the fan-out, REFILLING for the remaining readers if they were only waiting on this one.
+static void fan_out_leave(FanOut *fan) {
+    pthread_mutex_lock(&fan->lock);
+
+    fan->readers -= 1;
+    if (fan->waiting > 0 && fan->waiting == fan->readers) {
+        fan_out_refill(fan);
+    }
+
+    pthread_mutex_unlock(&fan->lock);
+}
+
+static int fan_out_close(void *cookie) {
+    FanReader *r = (FanReader *) cookie;
+
+    fan_out_leave(r->fan);
+    free(r);
+
+    return 0;
+}
+
+// ENCRYPTS the shared input to one recipient.
+static void *fan_out_worker(void *arg) {
+    FanWorker *w = (FanWorker *) arg;
+    FanOut *fan = w->fan;
+    size_t i = w->index;
+
+    // OPEN a private read stream over the shared chunk.
+    FanReader *r = (FanReader *) calloc(1, sizeof(FanReader));
+    cookie_io_functions_t io = { .read = fan_out_read, .close = fan_out_close };
+    FILE *input = NULL;
+
+    if (r != NULL) {
+        r->fan = fan;
+        input = fopencookie(r, "r", io);
+    }
+
+    FILE *output = fan->recipients[i].output_file;
+    bool encrypted = true;
+
+    if (input == NULL) {
+        // LEAVE the fan-out, so the other readers do not wait on this one.
+        free(r);
+        fan_out_leave(fan);
+        fprintf(stderr, "Error: Encrypt could not read input for recipient %zu.\n", i + 1);
+    } else if (fan->codec != CODEC_NONE) {
+        encrypted = ss_encrypt_file_compressed(input, output, fan->recipients[i].n, fan->codec);
+    } else {
+        ss_encrypt_file(input, output, fan->recipients[i].n);
+    }
+
+    if (input != NULL) {
+        fclose(input);
+    }
+
+    // RECORD a recipient whose ciphertext is missing or incomplete.
+    if (input == NULL || !encrypted || fflush(output) != 0 || ferror(output)) {
+        pthread_mutex_lock(&fan->lock);
+        fan->failed = true;
+        pthread_mutex_unlock(&fan->lock);
+    }
+
+    return NULL;
+}
+
+// READS the plaintext offset and ciphertext size recorded by the last incremental run.
+// A missing checkpoint means nothing has been encrypted yet.
+static bool read_checkpoint(const char *path, uint64_t *offset, uint64_t *out_size) {
+    *offset = 0;
+    *out_size = 0;
+
+    FILE *ckfile = fopen(path, "r");
+
+    if (ckfile == NULL) {
+        return true;
+    }
+
+    bool valid = fscanf(ckfile, "%lu %lu", offset, out_size) == 2;
+
+    fclose(ckfile);
+
+    return valid;
+}
+
+// WRITES the checkpoint through a temporary file so a crash never leaves it half-written.
+static bool write_checkpoint(const char *path, uint64_t offset, uint64_t out_size) {
+    char *tmp = (char *) malloc(strlen(path) + 5);
+    sprintf(tmp, "%s.tmp", path);
+
+    FILE *ckfile = fopen(tmp, "w");
+    bool written = ckfile != NULL;
+
+    if (written) {
+        fprintf(ckfile, "%lu %lu\n", offset, out_size);
+        written = fclose(ckfile) == 0 && rename(tmp, path) == 0;
+    }
+
+    free(tmp);
+
+    return written;
+}
+
+// ENCRYPTS shard 'index' of 'count' shards of 'input_file', or all of them if 'index' is
+// negative, into shard files next to the manifest 'manifest_name'.
+static int encrypt_shards(
+    FILE *input_file, const char *manifest_name, const mpz_t n, uint64_t count, int64_t index) {
+    struct stat in_stat;
+
+    if (fstat(fileno(input_file), &in_stat) != 0 || !S_ISREG(in_stat.st_mode)) {
+        fprintf(stderr, "Error: Encrypt can only shard a regular input file.\n");
+        return 1;
+    }
+
+    if (index >= (int64_t) count) {
+        fprintf(stderr, "Error: Encrypt shard index is out of range.\n");
+        return 1;
+    }
+
+    // PLAN the shards. Every process computes the same plan.
+    Manifest m;
+    shard_plan(&m, manifest_name, ss_fingerprint(n), in_stat.st_size, ss_block_size(n) - 1, count);
+
+    // REFUSE to overwrite the manifest of another key or input when encrypting a single shard,
+    // since shards of different runs would then be mixed silently.
+    Manifest existing;
+
+    if (index >= 0 && shard_read_manifest(&existing, manifest_name)) {
+        bool same = existing.fingerprint == m.fingerprint && existing.size == m.size
+                    && existing.block == m.block && existing.count == m.count;
+
+        shard_clear(&existing);
+
+        if (!same) {
+            fprintf(stderr,
+                "Error: Encrypt shard manifest was planned for another key or input.\n");
+            shard_clear(&m);
+            return 1;
+        }
+    }
+
+    if (!shard_write_manifest(&m, manifest_name)) {
+        fprintf(stderr, "Error: Encrypt could not write shard manifest.\n");
+        shard_clear(&m);
+        return 1;
+    }
+
+    int status = 0;
+
+    for (uint64_t i = 0; i < count && status == 0; i += 1) {
+        if (index >= 0 && i != (uint64_t) index) {
+            continue;
+        }
+
+        char *path = shard_path(manifest_name, &m.shards[i]);
+        FILE *shard_file = fopen(path, "w");
+
+        free(path);
+
+        if (shard_file == NULL || fseeko(input_file, m.shards[i].offset, SEEK_SET) != 0) {
+            fprintf(stderr, "Error: Encrypt could not access shard %lu.\n", i);
+
+            if (shard_file != NULL) {
+                fclose(shard_file);
+            }
+
+            status = 1;
+            break;
+        }
+
+        // ENCRYPT only this shard's byte range, OVERLAPPING reads and writes with the block loop.
+        FILE *async_in = aio_reader(input_file);
+        FILE *shard_in = shard_reader(async_in, m.shards[i].length);
+        FILE *async_out = aio_writer(shard_file);
+
+        ss_encrypt_file(shard_in, async_out, n);
+
+        fclose(shard_in);
+
+        if (async_in != input_file) {
+            fclose(async_in);
+        }
+
+        if ((async_out != shard_file && fclose(async_out) != 0) || fclose(shard_file) != 0) {
+            fprintf(stderr, "Error: Encrypt could not write shard %lu.\n", i);
+            status = 1;
+        }
+    }
+
+    shard_clear(&m);
+
+    return status;
+}
 
 int main(int argc, char **argv) {
 
@@ -17,14 +312,23 @@ int main(int argc, char **argv) {
 
     bool toggle_i = false;
     bool toggle_o = false;
+    bool toggle_a = false;
     bool verbose_output = false;
 
-    char username[LOGIN_NAME_MAX];
-    char *pub_file = "ss.pub";
+    KeySource default_key = { 'n', "ss.pub" };
+    KeySource *key_sources = &default_key;
+    size_t num_keys = 0;
+    char *ring_name = NULL;
     char *in_name = "default_input";
     char *out_name = "default_output";
+    char *stats_name = NULL;
+    char *checkpoint_name = NULL;
 
-    mpz_t n;
+    Codec codec = CODEC_NONE;
+
+    uint64_t num_shards = 0;
+    char *batch_name = NULL;
+    int64_t shard_index = -1;
 
     while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
         switch (opt) {
@@ -38,8 +342,41 @@ int main(int argc, char **argv) {
             out_name = optarg;
 
             break;
-        case 'n': // SPECIFY public key file.
-            pub_file = optarg;
+        case 'n': // SPECIFY public key file. May be repeated to encrypt to several keys.
+        case 'u': // SPECIFY keyring user. May be repeated as well.
+        case 'F': // SPECIFY keyring key fingerprint. May be repeated as well.
+            key_sources = (num_keys == 0) ? NULL : key_sources;
+            key_sources = (KeySource *) realloc(key_sources, (num_keys + 1) * sizeof(KeySource));
+            key_sources[num_keys++] = (KeySource) { opt, optarg };
+
+            break;
+        case 'K': // SPECIFY keyring file.
+            ring_name = optarg;
+
+            break;
+        case 'a': // SPECIFY checkpoint file for incremental encryption.
+            toggle_a = true;
+            checkpoint_name = optarg;
+
+            break;
+        case 'z': // ENABLE compression before encryption.
+            codec = compress_best_codec();
+
+            break;
+        case 't': // SPECIFY per-block statistics file.
+            stats_name = optarg;
+
+            break;
+        case 'x': // SPECIFY # of shards to split the input into.
+            num_shards = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'I': // SPECIFY the one shard to encrypt.
+            shard_index = strtol(optarg, NULL, 10);
+
+            break;
+        case 'B': // SPECIFY batch manifest of input and output files.
+            batch_name = optarg;
 
             break;
         case 'v': // ENABLE verbose output.
@@ -58,26 +395,137 @@ int main(int argc, char **argv) {
             printf("   -i infile       Input file of data to encrypt (default: stdin).\n");
             printf("   -o outfile      Output file for encrypted data (default: stdout).\n");
             printf("   -n pbfile       Public key file (default: ss.pub).\n");
+            printf("                   Repeat to encrypt to several keys in one pass; output for\n");
+            printf("                   the i-th key is written to outfile.i.\n");
+            printf("   -u username     Public key of username from the keyring (needs -K).\n");
+            printf("   -F fingerprint  Public key with this hex fingerprint from the keyring.\n");
+            printf("   -K ringfile     Keyring written by the keyring program.\n");
+            printf("   -a ckfile       Append only the input bytes added since the run recorded\n");
+            printf("                   in checkpoint ckfile, then update it (needs -i and -o).\n");
+            printf("   -z              Compress data before encrypting it.\n");
+            printf("   -t statsfile    Write per-block latency statistics as JSON at exit.\n");
+            printf("   -x shards       Split the input into shards on block boundaries; outfile\n");
+            printf("                   becomes a manifest and shard i is written to outfile.i.\n");
+            printf("   -I index        With -x, only encrypt shard index (one process per shard).\n");
+            printf("   -B batchfile    Encrypt every \"infile outfile\" line of batchfile on all\n");
+            printf("                   cores, loading the key once.\n");
 
             break;
         }
     }
 
-    // OPEN the public key file.
+    if (num_keys == 0) {
+        num_keys = 1;
+    } else if (num_keys > 1 && !toggle_o) {
+        fprintf(stderr, "Error: Encrypt needs -o when encrypting to several keys.\n");
+        return 1;
+    }
+
+    if (toggle_a && (!toggle_i || !toggle_o || num_keys > 1 || codec != CODEC_NONE)) {
+        fprintf(stderr, "Error: Encrypt needs -i, -o, a single key and no -z for -a.\n");
+        return 1;
+    }
 
-    FILE *pbfile = fopen(pub_file, "r");
+    if (num_shards > 0 && (!toggle_i || !toggle_o || num_keys > 1 || toggle_a)) {
+        fprintf(stderr, "Error: Encrypt needs -i, -o, a single key and no -a for -x.\n");
+        return 1;
+    }
 
-    if (pbfile == NULL) {
-        fprintf(stderr, "Error: Encrypt could not access public key file.\n");
+    if (batch_name != NULL && (num_keys > 1 || toggle_a || num_shards > 0)) {
+        fprintf(stderr, "Error: Encrypt needs a single key and no -a or -x for -B.\n");
         return 1;
     }
 
-    // CREATE and OPEN input and output files.
+    if (num_shards > 0 && codec != CODEC_NONE) {
+        fprintf(stderr, "Error: Encrypt cannot compress sharded output.\n");
+        return 1;
+    }
+
+    // READ the checkpoint of the last incremental run.
+
+    uint64_t offset = 0;
+    uint64_t out_size = 0;
+
+    if (toggle_a && !read_checkpoint(checkpoint_name, &offset, &out_size)) {
+        fprintf(stderr, "Error: Encrypt could not read checkpoint file.\n");
+        return 1;
+    }
+
+    // ENABLE per-block statistics if a statistics file was given.
+
+    FILE *stats_file = NULL;
+
+    if (stats_name != NULL) {
+        stats_file = fopen(stats_name, "w");
+        if (stats_file == NULL) {
+            fprintf(stderr, "Error: Encrypt could not access statistics file.\n");
+            return 1;
+        }
+
+        stats_init();
+    }
+
+    // READ every public key.
+
+    Recipient *recipients = (Recipient *) calloc(num_keys, sizeof(Recipient));
+
+    Keyring ring = { 0 };
+
+    if (ring_name != NULL && !ring_open(&ring, ring_name)) {
+        fprintf(stderr, "Error: Encrypt could not read keyring file.\n");
+        return 1;
+    }
+
+    for (size_t i = 0; i < num_keys; i += 1) {
+        KeySource *source = &key_sources[i];
+
+        mpz_init(recipients[i].n);
+
+        if (source->kind == 'n') {
+            FILE *pbfile = fopen(source->name, "r");
+
+            if (pbfile == NULL) {
+                fprintf(stderr, "Error: Encrypt could not access public key file.\n");
+                return 1;
+            }
+
+            ss_read_pub(recipients[i].n, recipients[i].username, pbfile);
+
+            fclose(pbfile);
+        } else {
+            // LOOK UP the key in the memory-mapped keyring.
+            bool found = false;
+
+            if (ring.map != NULL && source->kind == 'u') {
+                found = ring_find_user(&ring, source->name, recipients[i].n);
+                snprintf(recipients[i].username, LOGIN_NAME_MAX, "%s", source->name);
+            } else if (ring.map != NULL) {
+                found = ring_find_fingerprint(
+                    &ring, strtoull(source->name, NULL, 16), recipients[i].n, recipients[i].username);
+            }
+
+            if (!found) {
+                fprintf(stderr, "Error: Encrypt could not find key %s in keyring.\n", source->name);
+                return 1;
+            }
+        }
+
+        // DO if verbose output is enabled.
+
+        if (verbose_output) {
+            gmp_fprintf(stdout, "user = %s\n", recipients[i].username);
+            gmp_fprintf(stdout, "n (%d bits) = %Zd\n", mpz_sizeinbase(recipients[i].n, 2),
+                recipients[i].n);
+        }
+    }
+
+    ring_close(&ring);
+
+    // CREATE and OPEN input and output files. A batch opens its own.
 
     FILE *input_file;
-    FILE *output_file;
 
-    if (toggle_i) {
+    if (toggle_i && batch_name == NULL) {
         input_file = fopen(in_name, "r");
         if (input_file == NULL) {
             fprintf(stderr, "Error: Encrypt could not access input file.\n");
@@ -87,39 +535,194 @@ int main(int argc, char **argv) {
         input_file = stdin;
     }
 
-    if (toggle_o) {
-        output_file = fopen(out_name, "w");
-        if (output_file == NULL) {
-            fprintf(stderr, "Error: Encrypt could not access output file.\n");
-            return 1;
-        }
+    // ENCRYPT every file of a batch, or shards, instead of a single output if requested.
+
+    int status = 0;
+
+    if (batch_name != NULL) {
+        uint64_t num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = (num_threads < 1) ? 1 : num_threads;
+
+        status = batch_encrypt(batch_name, recipients[0].n, codec, num_threads) ? 0 : 1;
+    } else if (num_shards > 0) {
+        status = encrypt_shards(input_file, out_name, recipients[0].n, num_shards, shard_index);
     } else {
-        output_file = stdout;
-    }
+        if (toggle_a) {
+            // RESUME after the last processed byte, appending to the ciphertext written so far.
+            recipients[0].output_file = fopen(out_name, "a");
+
+            if (recipients[0].output_file != NULL) {
+                struct stat in_stat, out_stat;
+
+                fstat(fileno(input_file), &in_stat);
+                fstat(fileno(recipients[0].output_file), &out_stat);
+
+                if ((uint64_t) in_stat.st_size < offset
+                    || (uint64_t) out_stat.st_size < out_size) {
+                    fprintf(stderr, "Error: Encrypt input or output does not match checkpoint.\n");
+                    return 1;
+                }
+
+                // CUT OFF ciphertext a crashed run appended after its last checkpoint.
+                if ((uint64_t) out_stat.st_size > out_size
+                    && ftruncate(fileno(recipients[0].output_file), out_size) != 0) {
+                    fprintf(stderr, "Error: Encrypt could not roll output back to checkpoint.\n");
+                    return 1;
+                }
+
+                fseek(input_file, offset, SEEK_SET);
+            }
+        } else if (num_keys == 1) {
+            recipients[0].output_file = toggle_o ? fopen(out_name, "w") : stdout;
+        } else {
+            char *name = (char *) malloc(strlen(out_name) + 24);
+
+            for (size_t i = 0; i < num_keys; i += 1) {
+                sprintf(name, "%s.%zu", out_name, i + 1);
+                recipients[i].output_file = fopen(name, "w");
+
+                if (recipients[i].output_file == NULL) {
+                    break;
+                }
+            }
+
+            free(name);
+        }
+
+        for (size_t i = 0; i < num_keys; i += 1) {
+            if (recipients[i].output_file == NULL) {
+                fprintf(stderr, "Error: Encrypt could not access output file.\n");
+                return 1;
+            }
+        }
+
+        // ENCRYPT file. A single key streams the input; several keys share a bounded chunk of it.
+
+        if (toggle_a) {
+            // SKIP encryption when no bytes have arrived, so no empty block is appended.
+            if (fgetc(input_file) != EOF) {
+                fseek(input_file, offset, SEEK_SET);
+                ss_encrypt_file(input_file, recipients[0].output_file, recipients[0].n);
+            }
+
+            // SYNC the ciphertext to disk before the checkpoint that covers it.
+            struct stat out_stat;
+
+            if (fflush(recipients[0].output_file) != 0
+                || fsync(fileno(recipients[0].output_file)) != 0) {
+                fprintf(stderr, "Error: Encrypt could not write output file.\n");
+                return 1;
+            }
+
+            fstat(fileno(recipients[0].output_file), &out_stat);
+
+            if (!write_checkpoint(checkpoint_name, ftell(input_file), out_stat.st_size)) {
+                fprintf(stderr, "Error: Encrypt could not write checkpoint file.\n");
+                return 1;
+            }
+        } else if (num_keys == 1) {
+            // OVERLAP reads and writes with the block loop.
+            FILE *async_in = aio_reader(input_file);
+            FILE *async_out = aio_writer(recipients[0].output_file);
+
+            if (codec != CODEC_NONE) {
+                bool compressed
+                    = ss_encrypt_file_compressed(async_in, async_out, recipients[0].n, codec);
+                status = compressed ? 0 : 1;
+            } else {
+                ss_encrypt_file(async_in, async_out, recipients[0].n);
+            }
+
+            if (async_in != input_file) {
+                fclose(async_in);
+            }
+
+            if (async_out != recipients[0].output_file && fclose(async_out) != 0) {
+                fprintf(stderr, "Error: Encrypt could not write output file.\n");
+                return 1;
+            }
+        } else {
+            FanOut fan = { .input = input_file,
+                .chunk = (uint8_t *) malloc(FAN_OUT_BYTES),
+                .readers = num_keys,
+                .recipients = recipients,
+                .num_recipients = num_keys,
+                .codec = codec };
+
+            if (fan.chunk == NULL) {
+                fprintf(stderr, "Error: Encrypt could not buffer input file.\n");
+                return 1;
+            }
 
-    // INITIALIZE multiple-precision variables.
+            pthread_mutex_init(&fan.lock, NULL);
+            pthread_cond_init(&fan.refilled, NULL);
 
-    mpz_init(n);
+            // START one thread per recipient, since every recipient reads each chunk.
+            pthread_t *threads = (pthread_t *) malloc(num_keys * sizeof(pthread_t));
+            FanWorker *workers = (FanWorker *) malloc(num_keys * sizeof(FanWorker));
+            bool *started = (bool *) calloc(num_keys, sizeof(bool));
 
-    // READ the public key from the public key file.
+            for (size_t i = 0; i < num_keys; i += 1) {
+                workers[i] = (FanWorker) { &fan, i };
+                started[i] = pthread_create(&threads[i], NULL, fan_out_worker, &workers[i]) == 0;
 
-    ss_read_pub(n, username, pbfile);
+                if (!started[i]) {
+                    pthread_mutex_lock(&fan.lock);
+                    fan.failed = true;
+                    pthread_mutex_unlock(&fan.lock);
+                    fan_out_leave(&fan);
+                }
+            }
 
-    // DO if verbose output is enabled.
+            for (size_t i = 0; i < num_keys; i += 1) {
+                if (started[i]) {
+                    pthread_join(threads[i], NULL);
+                }
+            }
 
-    if (verbose_output) {
-        gmp_fprintf(stdout, "user = %s\n", username);
-        gmp_fprintf(stdout, "n (%d bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+            pthread_cond_destroy(&fan.refilled);
+            pthread_mutex_destroy(&fan.lock);
+            free(threads);
+            free(workers);
+            free(started);
+            free(fan.chunk);
+
+            if (fan.read_failed) {
+                fprintf(stderr, "Error: Encrypt could not read input file.\n");
+                status = 1;
+            } else if (fan.failed) {
+                fprintf(stderr, "Error: Encrypt could not write output for every key.\n");
+                status = 1;
+            }
+        }
     }
 
-    // ENCRYPT file.
-    ss_encrypt_file(input_file, output_file, n);
+    // CLOSE files and CLEAR variables.
 
-    // CLOSE public key file and CLEAR variables.
+    for (size_t i = 0; i < num_keys; i += 1) {
+        if (recipients[i].output_file != NULL && recipients[i].output_file != stdout) {
+            fclose(recipients[i].output_file);
+        }
 
-    fclose(pbfile);
+        mpz_clear(recipients[i].n);
+    }
 
-    mpz_clear(n);
+    if (input_file != stdin) {
+        fclose(input_file);
+    }
 
-    return 0;
+    free(recipients);
+
+    if (key_sources != &default_key) {
+        free(key_sources);
+    }
+
+    // WRITE per-block statistics.
+
+    if (stats_file != NULL) {
+        stats_dump("encrypt", stats_file);
+        fclose(stats_file);
+    }
+
+    return status;
 }
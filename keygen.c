@@ -8,21 +8,26 @@
 
 #include "ss.h"
 #include "randstate.h"
+#include "pool.h"
 
-#define OPTIONS "b:i:n:d:s:vh"
+#define OPTIONS "b:i:n:d:s:p:r:vh"
 
 int main(int argc, char **argv) {
 
     uint64_t opt = 0;
     uint64_t bits = 256;
     uint64_t iters = 50;
-    uint64_t seed = time(NULL);
+    uint64_t seed = 0;
+
+    bool seeded = false;
+    RandSource source = RAND_CHACHA;
 
     bool verbose_output = false;
 
     char *username = NULL;
     char *pub_file = "ss.pub";
     char *priv_file = "ss.priv";
+    char *pool_dir = NULL;
 
     mpz_t pq, p, q, n, d;
 
@@ -46,6 +51,18 @@ int main(int argc, char **argv) {
             break;
         case 's': // SPECIFY seed.
             seed = strtoul(optarg, NULL, 10);
+            seeded = true;
+
+            break;
+        case 'r': // SPECIFY random source.
+            if (!randstate_source_from_name(&source, optarg)) {
+                fprintf(stderr, "Error: Keygen does not know random source %s.\n", optarg);
+                return 1;
+            }
+
+            break;
+        case 'p': // SPECIFY prime pool directory.
+            pool_dir = optarg;
 
             break;
         case 'v': // ENABLE verbose output.
@@ -65,7 +82,9 @@ int main(int argc, char **argv) {
                 "   -i iterations   Miller-Rabin iterations for testing primes (default: 50).\n");
             printf("   -n pbfile       Public key file (default: ss.pub).\n");
             printf("   -d pvfile       Private key file (default: ss.priv).\n");
-            printf("   -s seed         Random seed for testing.\n");
+            printf("   -s seed         Random seed for testing (default: from getrandom).\n");
+            printf("   -r source       Random source, chacha or mt (default: chacha).\n");
+            printf("   -p pooldir      Prime pool to take primes from (default: none).\n");
 
             break;
         }
@@ -91,10 +110,21 @@ int main(int argc, char **argv) {
 
     fchmod(fileno(pvfile), S_IRUSR | S_IWUSR);
 
+    // OPEN the prime pool, if one was given.
+
+    if (!pool_init(pool_dir)) {
+        fprintf(stderr, "Error: Keygen could not access prime pool, or it is not private.\n");
+        return 1;
+    }
+
     // INITIALIZE multiple-precision variables and random state.
 
     mpz_inits(pq, p, q, n, d, NULL);
-    randstate_init(seed);
+
+    if (!randstate_init_source(source, seeded, seed)) {
+        fprintf(stderr, "Error: Keygen could not seed random source.\n");
+        return 1;
+    }
 
     // GENERATE public and private keys.
 
@@ -127,6 +157,7 @@ int main(int argc, char **argv) {
     fclose(pvfile);
 
     randstate_clear();
+    pool_clear();
 
     mpz_clears(pq, p, q, n, d, NULL);
 
@@ -0,0 +1,179 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include <getopt.h>
+#include <gmp.h>
+#include <unistd.h>
+
+#include "ss.h"
+#include "ring.h"
+
+#define OPTIONS "o:lvh"
+
+int main(int argc, char **argv) {
+
+    int opt = 0;
+
+    bool list = false;
+    bool verbose_output = false;
+
+    char *ring_file = "ss.ring";
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'o': // SPECIFY keyring file.
+            ring_file = optarg;
+
+            break;
+        case 'l': // LIST the keyring instead of building it.
+            list = true;
+
+            break;
+        case 'v': // ENABLE verbose output.
+            verbose_output = true;
+
+            break;
+        case 'h': // DISPLAY program usage.
+            printf("SYNOPSIS\n");
+            printf("   Packs SS public keys into an indexed keyring for encrypt -K.\n\n");
+            printf("USAGE\n");
+            printf("   ./keyring [OPTIONS] [pbfile ...]\n\n");
+            printf("OPTIONS\n");
+            printf("   -h              Display program help and usage.\n");
+            printf("   -v              Display verbose program output.\n");
+            printf("   -o ringfile     Keyring file (default: ss.ring).\n");
+            printf("   -l              List the keys in the keyring.\n");
+            printf("   pbfile ...      Public key files to pack (default: one path per line\n");
+            printf("                   on stdin).\n");
+
+            return 0;
+        }
+    }
+
+    // LIST the keyring.
+
+    if (list) {
+        Keyring ring;
+
+        if (!ring_open(&ring, ring_file)) {
+            fprintf(stderr, "Error: Keyring could not read keyring file.\n");
+            return 1;
+        }
+
+        mpz_t n;
+        mpz_init(n);
+        char username[LOGIN_NAME_MAX + 1];
+
+        bool listed = true;
+
+        for (uint64_t i = 0; listed && i < ring.count; i += 1) {
+            listed = ring_entry(&ring, i, n, username);
+            if (listed) {
+                printf("%016lx %s (%zu bits)\n", ss_fingerprint(n), username,
+                    mpz_sizeinbase(n, 2));
+            }
+        }
+
+        mpz_clear(n);
+        ring_close(&ring);
+
+        if (!listed) {
+            fprintf(stderr, "Error: Keyring found a corrupt entry in keyring file.\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    // COLLECT the public key files from the arguments, or from stdin.
+
+    uint64_t count = 0;
+    uint64_t capacity = 16;
+    mpz_t *keys = (mpz_t *) malloc(capacity * sizeof(mpz_t));
+    char **usernames = (char **) malloc(capacity * sizeof(char *));
+
+    char path[PATH_MAX];
+
+    for (int arg = optind;; arg += 1) {
+        const char *pub_file = path;
+
+        if (optind < argc) {
+            if (arg == argc) {
+                break;
+            }
+
+            pub_file = argv[arg];
+        } else {
+            if (fgets(path, sizeof(path), stdin) == NULL) {
+                break;
+            }
+
+            path[strcspn(path, "\n")] = '\0';
+
+            if (path[0] == '\0') {
+                continue;
+            }
+        }
+
+        FILE *pbfile = fopen(pub_file, "r");
+
+        if (pbfile == NULL) {
+            fprintf(stderr, "Error: Keyring could not access public key file %s.\n", pub_file);
+            return 1;
+        }
+
+        if (count == capacity) {
+            capacity *= 2;
+            keys = (mpz_t *) realloc(keys, capacity * sizeof(mpz_t));
+            usernames = (char **) realloc(usernames, capacity * sizeof(char *));
+        }
+
+        char username[LOGIN_NAME_MAX + 1] = "";
+
+        mpz_init(keys[count]);
+        ss_read_pub(keys[count], username, pbfile);
+        usernames[count] = strdup(username);
+
+        fclose(pbfile);
+
+        if (verbose_output) {
+            printf("%016lx %s\n", ss_fingerprint(keys[count]), username);
+        }
+
+        count += 1;
+    }
+
+    // WRITE the keyring to a temporary file and RENAME it over the old one, so processes that
+    // have the old keyring mapped, or a crash mid-write, never see a half-written keyring.
+
+    char *tmp = (char *) malloc(strlen(ring_file) + 32);
+    sprintf(tmp, "%s.%d.tmp", ring_file, (int) getpid());
+
+    FILE *ringfile = fopen(tmp, "w");
+    bool written = ringfile != NULL && ring_write(keys, usernames, count, ringfile);
+
+    if (ringfile != NULL) {
+        written = (fclose(ringfile) == 0) && written && rename(tmp, ring_file) == 0;
+    }
+
+    if (!written) {
+        remove(tmp);
+        free(tmp);
+        fprintf(stderr, "Error: Keyring could not write keyring file.\n");
+        return 1;
+    }
+
+    free(tmp);
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        mpz_clear(keys[i]);
+        free(usernames[i]);
+    }
+
+    free(keys);
+    free(usernames);
+
+    return 0;
+}
@@ -79,7 +79,7 @@ bool is_prime(const mpz_t n, uint64_t iters) {
     for (uint64_t i = 1; i < iters; i += 1) {
 
         // Choose a RANDOM element in {2, 3, ..., n - 2}.
-        mpz_urandomm(a, state, n_minus_3);
+        randstate_urandomm(a, n_minus_3);
         mpz_add_ui(a, a, 2);
 
         pow_mod(y, a, r, n);
@@ -126,7 +126,7 @@ void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
     while (!is_prime(p, iters)) {
 
         // CREATE a random number with 'bits' bits.
-        mpz_urandomb(p, state, bits);
+        randstate_urandomb(p, bits);
 
         mpz_setbit(p, bits - 1);
     }
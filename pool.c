@@ -0,0 +1,161 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <gmp.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+static char *pool = NULL;
+
+// RETURNS the path of the pool file for 'bits'-bit primes. The caller frees it.
+static char *pool_path(const char *pool_dir, uint64_t bits) {
+    size_t len = strlen(pool_dir) + 24;
+    char *path = (char *) malloc(len);
+
+    snprintf(path, len, "%s/%lu", pool_dir, bits);
+
+    return path;
+}
+
+// OPENS the global pool directory 'pool', if it is private to its owner.
+bool pool_init(const char *pool_dir) {
+    pool = NULL;
+
+    if (pool_dir == NULL) {
+        return true;
+    }
+
+    struct stat st;
+
+    if (stat(pool_dir, &st) != 0 || !S_ISDIR(st.st_mode) || (st.st_mode & (S_IRWXG | S_IRWXO))) {
+        return false;
+    }
+
+    pool = strdup(pool_dir);
+
+    return true;
+}
+
+// CLOSES the global pool directory, 'pool'.
+void pool_clear(void) {
+    free(pool);
+    pool = NULL;
+}
+
+bool pool_take(mpz_t p, uint64_t bits) {
+    if (pool == NULL) {
+        return false;
+    }
+
+    char *path = pool_path(pool, bits);
+    int fd = open(path, O_RDWR);
+
+    free(path);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    // LOCK the file against other keygen and primepool processes.
+    flock(fd, LOCK_EX);
+
+    // A line is the hex prime and a newline; read a little more to see the previous newline.
+    size_t cap = bits / 4 + 3;
+    char *buf = (char *) malloc(cap + 1);
+    bool found = false;
+
+    mpz_t prime;
+    mpz_init(prime);
+
+    // LOOP cutting off the last line until it is a valid prime or the file is empty.
+    struct stat st;
+
+    while (!found && fstat(fd, &st) == 0 && st.st_size > 0) {
+        off_t end = st.st_size;
+        off_t start = (end > (off_t) cap) ? end - (off_t) cap : 0;
+
+        if (pread(fd, buf, end - start, start) != end - start) {
+            break;
+        }
+
+        // A last line without a newline is an append cut short by a crash; it is dropped.
+        size_t len = end - start;
+        bool complete = buf[len - 1] == '\n';
+        buf[complete ? len - 1 : len] = '\0';
+
+        char *nl = memrchr(buf, '\n', complete ? len - 1 : len);
+        char *line = (nl == NULL) ? buf : nl + 1;
+        off_t line_start = start + (line - buf);
+
+        found = complete && (nl != NULL || start == 0) && mpz_set_str(prime, line, 16) == 0
+                && mpz_sizeinbase(prime, 2) == bits;
+
+        // CUT the line off before handing the prime out.
+        if (ftruncate(fd, line_start) != 0) {
+            fprintf(stderr, "Error: Could not shrink prime pool.\n");
+            found = false;
+            break;
+        }
+    }
+
+    if (found) {
+        mpz_set(p, prime);
+    }
+
+    // UNLOCK the file and DEALLOCATE the buffer.
+    flock(fd, LOCK_UN);
+    close(fd);
+    mpz_clear(prime);
+    free(buf);
+
+    return found;
+}
+
+bool pool_create(const char *pool_dir) {
+    if (mkdir(pool_dir, S_IRWXU) != 0 && errno != EEXIST) {
+        return false;
+    }
+
+    // ENSURE pool directory permissions are set to READ, WRITE and SEARCH by the owner only.
+    return chmod(pool_dir, S_IRWXU) == 0;
+}
+
+FILE *pool_open(const char *pool_dir, uint64_t bits) {
+    char *path = pool_path(pool_dir, bits);
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR);
+
+    free(path);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    // ENSURE pool file permissions are set to READ and WRITE.
+    fchmod(fd, S_IRUSR | S_IWUSR);
+
+    FILE *pool_file = fdopen(fd, "a");
+
+    if (pool_file == NULL) {
+        close(fd);
+    }
+
+    return pool_file;
+}
+
+void pool_put(const mpz_t p, FILE *pool_file) {
+    flock(fileno(pool_file), LOCK_EX);
+
+    gmp_fprintf(pool_file, "%Zx\n", p);
+    fflush(pool_file);
+
+    flock(fileno(pool_file), LOCK_UN);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// A prime pool is a directory private to its owner (mode 0700) holding one
+// file per prime size, named by the # of bits, with one hex prime per line.
+// Pooled primes become private key factors, so the pool is never shared.
+//
+
+//
+// Opens the prime pool directory that key generation draws primes from.
+// Without an open pool, every prime is found by a live search.
+//
+// pool_dir: path of the pool directory, or NULL to disable the pool.
+//
+// Returns false if the pool does not exist, is not a directory, or is
+// accessible by group or others.
+//
+bool pool_init(const char *pool_dir);
+
+//
+// Closes the prime pool, if one is open.
+//
+void pool_clear(void);
+
+//
+// Removes a prime of exactly 'bits' bits from the pool. The last line of
+// the size's file is read and then cut off with one ftruncate under an
+// exclusive flock, so a take costs the same however large the pool is, and
+// a crash can lose a prime but never hand the same prime out twice.
+//
+// Provides:
+//  p: a verified prime taken from the pool
+//
+// Requires:
+//  bits: exact # of bits in the wanted prime
+//  p: initialized mpz_t
+//
+// Returns false (leaving p untouched) if no such prime is pooled.
+//
+bool pool_take(mpz_t p, uint64_t bits);
+
+//
+// Creates the pool directory if needed and restricts it to its owner.
+//
+// Returns false if the directory could not be created.
+//
+bool pool_create(const char *pool_dir);
+
+//
+// Opens the pool file for primes of 'bits' bits for appending, creating it
+// readable and writable only by its owner.
+//
+// Returns NULL if the file could not be opened.
+//
+FILE *pool_open(const char *pool_dir, uint64_t bits);
+
+//
+// Appends a verified prime to a pool file.
+//
+// Requires:
+//  p: prime to store
+//  pool_file: stream returned by pool_open
+//
+void pool_put(const mpz_t p, FILE *pool_file);
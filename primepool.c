@@ -0,0 +1,178 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <gmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ss.h"
+#include "numtheory.h"
+#include "randstate.h"
+#include "pool.h"
+
+#define OPTIONS "b:i:c:j:p:s:r:vh"
+
+// FILLS 'pool_dir' with 'count' primes of every p and q size that 'ss_make_pub' draws for
+// 'bits', handling every 'jobs'-th p size starting from 'worker'.
+static void fill_pool(const char *pool_dir, uint64_t bits, uint64_t iters, uint64_t count,
+    uint64_t worker, uint64_t jobs, bool verbose_output) {
+    mpz_t p;
+    mpz_init(p);
+
+    // LOOP over the p sizes assigned to this worker, using the same split as 'ss_make_pub'.
+    for (uint64_t p_bits = (bits / 5) + worker; p_bits < (2 * bits) / 5; p_bits += jobs) {
+        uint64_t q_bits = ss_q_bits(bits, p_bits);
+
+        FILE *p_out = pool_open(pool_dir, p_bits);
+        FILE *q_out = pool_open(pool_dir, q_bits);
+
+        if (p_out == NULL || q_out == NULL) {
+            fprintf(stderr, "Error: Primepool could not access pool file.\n");
+            exit(1);
+        }
+
+        for (uint64_t c = 0; c < count; c += 1) {
+            make_prime(p, p_bits, iters);
+            pool_put(p, p_out);
+
+            make_prime(p, q_bits, iters);
+            pool_put(p, q_out);
+        }
+
+        fclose(p_out);
+        fclose(q_out);
+
+        if (verbose_output) {
+            fprintf(stderr, "worker %lu: %lu primes of %lu and %lu bits\n", worker, count,
+                p_bits, q_bits);
+        }
+    }
+
+    mpz_clear(p);
+}
+
+int main(int argc, char **argv) {
+
+    int opt = 0;
+    uint64_t bits = 256;
+    uint64_t iters = 50;
+    uint64_t count = 8;
+    uint64_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t seed = 0;
+
+    bool seeded = false;
+    RandSource source = RAND_CHACHA;
+
+    bool verbose_output = false;
+
+    char *pool_dir = "ss.pool";
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'b': // SPECIFY bits.
+            bits = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'i': // SPECIFY iterations.
+            iters = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'c': // SPECIFY primes per size.
+            count = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'j': // SPECIFY worker processes.
+            jobs = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'p': // SPECIFY pool directory.
+            pool_dir = optarg;
+
+            break;
+        case 's': // SPECIFY seed.
+            seed = strtoul(optarg, NULL, 10);
+            seeded = true;
+
+            break;
+        case 'r': // SPECIFY random source.
+            if (!randstate_source_from_name(&source, optarg)) {
+                fprintf(stderr, "Error: Primepool does not know random source %s.\n", optarg);
+                return 1;
+            }
+
+            break;
+        case 'v': // ENABLE verbose output.
+            verbose_output = true;
+
+            break;
+        case 'h': // DISPLAY program usage.
+            printf("SYNOPSIS\n");
+            printf("   Fills a pool of primes for fast SS key generation.\n");
+            printf("   Pooled primes are consumed by keygen -p.\n\n");
+            printf("USAGE\n");
+            printf("   ./primepool [OPTIONS]\n\n");
+            printf("OPTIONS\n");
+            printf("   -h              Display program help and usage.\n");
+            printf("   -v              Display verbose program output.\n");
+            printf("   -b bits         Public key bits to pool primes for (default: 256).\n");
+            printf(
+                "   -i iterations   Miller-Rabin iterations for testing primes (default: 50).\n");
+            printf("   -c count        Primes to add per prime size (default: 8).\n");
+            printf("   -j jobs         Worker processes (default: # of cores).\n");
+            printf("   -p pooldir      Prime pool directory (default: ss.pool).\n");
+            printf("   -s seed         Random seed for testing (default: from getrandom).\n");
+            printf("   -r source       Random source, chacha or mt (default: chacha).\n");
+
+            return 0;
+        }
+    }
+
+    if (jobs == 0) {
+        jobs = 1;
+    }
+
+    // CREATE the pool directory, private to its owner since pooled primes are private key factors.
+
+    if (!pool_create(pool_dir)) {
+        fprintf(stderr, "Error: Primepool could not create pool directory.\n");
+        return 1;
+    }
+
+    // FORK one worker per job, each drawing from its own random stream.
+
+    for (uint64_t worker = 0; worker < jobs; worker += 1) {
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            fprintf(stderr, "Error: Primepool could not start worker.\n");
+            return 1;
+        }
+
+        if (pid == 0) {
+            if (!randstate_init_source(source, seeded, seed)) {
+                fprintf(stderr, "Error: Primepool could not seed random source.\n");
+                return 1;
+            }
+            randstate_stream(worker);
+            fill_pool(pool_dir, bits, iters, count, worker, jobs, verbose_output);
+            randstate_clear();
+
+            return 0;
+        }
+    }
+
+    // WAIT for every worker to finish.
+
+    int status = 0;
+    int failed = 0;
+
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
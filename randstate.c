@@ -1,21 +1,264 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <gmp.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <sys/random.h>
 
 #include "randstate.h"
 
+// ChaCha20 blocks generated per refill of a thread's keystream buffer.
+#define CHACHA_BLOCKS 16
+#define CHACHA_BYTES  (CHACHA_BLOCKS * 64)
+
 gmp_randstate_t state;
 
+static RandSource source = RAND_MT;
+static uint64_t base_seed = 0;
+static uint32_t key[8];
+
+// Bumped by every init, so threads notice they must rekey their stream.
+static uint64_t generation = 0;
+
+// A thread's ChaCha20 stream: its input block and a buffer of unread keystream.
+typedef struct {
+    uint64_t generation;
+    uint64_t stream;
+    uint32_t input[16];
+    uint8_t buffer[CHACHA_BYTES];
+    size_t used;
+} ChaCha;
+
+static _Thread_local ChaCha chacha;
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d)                                                                        \
+    a += b, d ^= a, d = ROTL(d, 16), c += d, b ^= c, b = ROTL(b, 12), a += b, d ^= a,              \
+                    d = ROTL(d, 8), c += d, b ^= c, b = ROTL(b, 7)
+
+// COMPUTES one 64-byte ChaCha20 block of 'input' into 'out' and ADVANCES the block counter.
+static void chacha_block(uint32_t input[16], uint8_t out[64]) {
+    uint32_t x[16];
+
+    memcpy(x, input, sizeof(x));
+
+    for (int round = 0; round < 20; round += 2) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i += 1) {
+        uint32_t word = x[i] + input[i];
+
+        out[4 * i] = word;
+        out[4 * i + 1] = word >> 8;
+        out[4 * i + 2] = word >> 16;
+        out[4 * i + 3] = word >> 24;
+    }
+
+    // The 64-bit block counter lives in words 12 and 13.
+    if (++input[12] == 0) {
+        input[13] += 1;
+    }
+}
+
+// KEYS the calling thread's stream from the shared key, with the stream number as nonce.
+static void chacha_rekey(uint64_t stream) {
+    static const uint32_t sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+
+    memcpy(chacha.input, sigma, sizeof(sigma));
+    memcpy(chacha.input + 4, key, sizeof(key));
+    chacha.input[12] = 0;
+    chacha.input[13] = 0;
+    chacha.input[14] = (uint32_t) stream;
+    chacha.input[15] = (uint32_t) (stream >> 32);
+
+    chacha.generation = generation;
+    chacha.stream = stream;
+    chacha.used = CHACHA_BYTES;
+}
+
+// COPIES 'len' keystream bytes into 'out', GENERATING whole blocks straight into 'out'
+// when they are not needed in the buffer.
+static void chacha_bytes(uint8_t *out, size_t len) {
+    if (chacha.generation != generation) {
+        chacha_rekey(chacha.stream);
+    }
+
+    while (len > 0) {
+        if (chacha.used == CHACHA_BYTES) {
+            for (; len >= 64; out += 64, len -= 64) {
+                chacha_block(chacha.input, out);
+            }
+
+            if (len == 0) {
+                break;
+            }
+
+            for (size_t b = 0; b < CHACHA_BLOCKS; b += 1) {
+                chacha_block(chacha.input, chacha.buffer + 64 * b);
+            }
+            chacha.used = 0;
+        }
+
+        size_t take = CHACHA_BYTES - chacha.used;
+        take = (take < len) ? take : len;
+
+        memcpy(out, chacha.buffer + chacha.used, take);
+        chacha.used += take;
+        out += take;
+        len -= take;
+    }
+}
+
+// RETURNS the next output of splitmix64, used to stretch a 64-bit seed into a key.
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+
+    return z ^ (z >> 31);
+}
+
 // INITIALIZES the global random state 'state' using 'seed' as the random seed.
 void randstate_init(uint64_t seed) {
-    srandom(seed);
+    randstate_init_source(RAND_MT, true, seed);
+}
 
+// INITIALIZES the chosen random source from 'seed', or from getrandom if not 'seeded'.
+bool randstate_init_source(RandSource src, bool seeded, uint64_t seed) {
+    source = src;
+    generation += 1;
+
+    if (seeded) {
+        uint64_t x = seed;
+
+        for (int i = 0; i < 8; i += 2) {
+            uint64_t word = splitmix64(&x);
+            key[i] = (uint32_t) word;
+            key[i + 1] = (uint32_t) (word >> 32);
+        }
+    } else if (getrandom(key, sizeof(key), 0) != sizeof(key)) {
+        return false;
+    } else {
+        memcpy(&seed, key, sizeof(seed));
+    }
+
+    base_seed = seed;
+
+    srandom(seed);
     gmp_randinit_mt(state);
     gmp_randseed_ui(state, seed);
+
+    return true;
 }
 
 // DEALLOCATES all memory used by the global random state, 'state'.
 void randstate_clear(void) {
     gmp_randclear(state);
+
+    memset(key, 0, sizeof(key));
+    memset(&chacha, 0, sizeof(chacha));
+}
+
+// SWITCHES the calling thread to stream 'stream'.
+void randstate_stream(uint64_t stream) {
+    if (source == RAND_MT) {
+        gmp_randseed_ui(state, base_seed + stream);
+    } else {
+        chacha_rekey(stream);
+    }
+}
+
+// FILLS 'count' limbs with random bits.
+void randstate_limbs(mp_limb_t *limbs, size_t count) {
+    if (source == RAND_MT) {
+        for (size_t i = 0; i < count; i += 1) {
+            limbs[i] = gmp_urandomb_ui(state, GMP_NUMB_BITS / 2);
+            limbs[i] = (limbs[i] << (GMP_NUMB_BITS / 2)) | gmp_urandomb_ui(state, GMP_NUMB_BITS / 2);
+        }
+    } else {
+        chacha_bytes((uint8_t *) limbs, count * sizeof(mp_limb_t));
+    }
+}
+
+// RETURNS a random integer below 'bound', REJECTING the biased top of the 64-bit range.
+uint64_t randstate_uniform(uint64_t bound) {
+    if (source == RAND_MT) {
+        return random() % bound;
+    }
+
+    uint64_t limit = UINT64_MAX - (UINT64_MAX % bound);
+    uint64_t x;
+
+    do {
+        chacha_bytes((uint8_t *) &x, sizeof(x));
+    } while (x >= limit);
+
+    return x % bound;
+}
+
+// SETS r to a random integer of at most 'bits' bits, written limb by limb.
+void randstate_urandomb(mpz_t r, uint64_t bits) {
+    if (source == RAND_MT) {
+        mpz_urandomb(r, state, bits);
+        return;
+    }
+
+    if (bits == 0) {
+        mpz_set_ui(r, 0);
+        return;
+    }
+
+    size_t count = (bits + GMP_NUMB_BITS - 1) / GMP_NUMB_BITS;
+    mp_limb_t *limbs = mpz_limbs_write(r, count);
+
+    randstate_limbs(limbs, count);
+
+    // MASK off the bits above 'bits' in the top limb.
+    if (bits % GMP_NUMB_BITS != 0) {
+        limbs[count - 1] &= GMP_NUMB_MAX >> (GMP_NUMB_BITS - bits % GMP_NUMB_BITS);
+    }
+
+    mpz_limbs_finish(r, count);
+}
+
+// SETS r to a random integer below n by rejection, which takes under two draws on average.
+void randstate_urandomm(mpz_t r, const mpz_t n) {
+    if (source == RAND_MT) {
+        mpz_urandomm(r, state, n);
+        return;
+    }
+
+    if (mpz_sgn(n) <= 0) {
+        mpz_set_ui(r, 0);
+        return;
+    }
+
+    uint64_t bits = mpz_sizeinbase(n, 2);
+
+    do {
+        randstate_urandomb(r, bits);
+    } while (mpz_cmp(r, n) >= 0);
+}
+
+bool randstate_source_from_name(RandSource *src, const char *name) {
+    if (strcmp(name, "chacha") == 0) {
+        *src = RAND_CHACHA;
+    } else if (strcmp(name, "mt") == 0) {
+        *src = RAND_MT;
+    } else {
+        return false;
+    }
+
+    return true;
 }
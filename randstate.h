@@ -2,20 +2,79 @@
 
 #include <stdio.h>
 #include <gmp.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+//
+// Random sources for SS key generation. RAND_CHACHA is a ChaCha20 counter
+// generator that fills limbs in bulk from a keystream buffer and gives every
+// thread its own stream. RAND_MT is GMP's Mersenne Twister, which gives
+// reproducible keys for a given seed within this build.
+//
+typedef enum { RAND_CHACHA, RAND_MT } RandSource;
+
+// GMP random state used by the RAND_MT source.
 extern gmp_randstate_t state;
 
 //
-// Initializes the random state needed for SS key generation operations.
-// Must be called before any key generation or number theory operations are used.
+// Initializes the random state needed for SS key generation operations with the
+// Mersenne Twister source. Must be called before any key generation or number
+// theory operations are used.
 //
 // seed: the seed to seed the random state with.
 //
 void randstate_init(uint64_t seed);
 
+//
+// Initializes the random state needed for SS key generation operations.
+// Must be called before any key generation or number theory operations are used.
+//
+// Requires:
+//  source: the random source to draw from
+//  seeded: true to use 'seed', false to key the source from getrandom
+//  seed: the seed to seed the random state with, if 'seeded'
+//
+// Returns false if getrandom failed.
+//
+bool randstate_init_source(RandSource source, bool seeded, uint64_t seed);
+
 //
 // Frees any memory used by the initialized random state.
 // Must be called after all key generation or number theory operations are used.
 //
 void randstate_clear(void);
+
+//
+// Switches the calling thread to independent stream 'stream' of the random state.
+// Threads draw from stream 0 until they switch. The RAND_MT source has one stream
+// per process, so it reseeds with seed + stream instead.
+//
+void randstate_stream(uint64_t stream);
+
+//
+// Fills 'count' limbs with random bits.
+//
+void randstate_limbs(mp_limb_t *limbs, size_t count);
+
+//
+// Returns a random integer in [0, bound). The RAND_MT source draws it from libc
+// random(), seeded with the same seed.
+//
+uint64_t randstate_uniform(uint64_t bound);
+
+//
+// Sets r to a uniformly random integer in [0, 2^bits).
+//
+void randstate_urandomb(mpz_t r, uint64_t bits);
+
+//
+// Sets r to a uniformly random integer in [0, n). r must not be n.
+//
+void randstate_urandomm(mpz_t r, const mpz_t n);
+
+//
+// Returns the random source named 'name' ("chacha" or "mt") in 'source'.
+//
+// Returns false if no source has that name.
+//
+bool randstate_source_from_name(RandSource *source, const char *name);
@@ -0,0 +1,167 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <gmp.h>
+#include <limits.h>
+#include <unistd.h>
+#include <signal.h>
+
+#include "ss.h"
+#include "batch.h"
+#include "stats.h"
+
+#define OPTIONS "i:o:d:n:B:j:zt:vh"
+
+int main(int argc, char **argv) {
+
+    uint64_t opt = 0;
+    uint64_t jobs = sysconf(_SC_NPROCESSORS_ONLN);
+
+    bool verbose_output = false;
+
+    Codec codec = CODEC_NONE;
+
+    char *priv_file = "ss.priv";
+    char *pub_file = "ss.pub";
+    char *in_name = "/dev/stdin";
+    char *out_name = "/dev/stdout";
+    char *batch_name = NULL;
+    char *stats_name = NULL;
+    char username[LOGIN_NAME_MAX];
+
+    mpz_t pq, d, n;
+
+    while ((opt = getopt(argc, argv, OPTIONS)) != -1) {
+        switch (opt) {
+        case 'i': // SPECIFY input file.
+            in_name = optarg;
+
+            break;
+        case 'o': // SPECIFY output file.
+            out_name = optarg;
+
+            break;
+        case 'd': // SPECIFY old private key file.
+            priv_file = optarg;
+
+            break;
+        case 'n': // SPECIFY new public key file.
+            pub_file = optarg;
+
+            break;
+        case 'B': // SPECIFY batch manifest of input and output files.
+            batch_name = optarg;
+
+            break;
+        case 'j': // SPECIFY worker threads.
+            jobs = strtoul(optarg, NULL, 10);
+
+            break;
+        case 'z': // ENABLE compression before encryption.
+            codec = compress_best_codec();
+
+            break;
+        case 't': // SPECIFY per-block statistics file.
+            stats_name = optarg;
+
+            break;
+        case 'v': // ENABLE verbose output.
+            verbose_output = true;
+
+            break;
+        case 'h': // DISPLAY program usage.
+            printf("SYNOPSIS\n");
+            printf("   Re-encrypts SS encrypted data under a new public key in one pass,\n");
+            printf("   without writing the plaintext anywhere.\n\n");
+            printf("USAGE\n");
+            printf("   ./reencrypt [OPTIONS]\n\n");
+            printf("OPTIONS\n");
+            printf("   -h              Display program help and usage.\n");
+            printf("   -v              Display verbose program output.\n");
+            printf("   -i infile       Input file of data to re-encrypt (default: stdin).\n");
+            printf("   -o outfile      Output file for re-encrypted data (default: stdout).\n");
+            printf("   -d pvfile       Old private key file (default: ss.priv).\n");
+            printf("   -n pbfile       New public key file (default: ss.pub).\n");
+            printf("   -B batchfile    Re-encrypt every \"infile outfile\" line of batchfile.\n");
+            printf("   -j jobs         Worker threads (default: # of cores).\n");
+            printf("   -z              Compress data before encrypting it under the new key.\n");
+            printf("   -t statsfile    Write per-block latency statistics of the encrypting\n");
+            printf("                   side as JSON at exit.\n");
+
+            return 0;
+        }
+    }
+
+    if (jobs == 0) {
+        jobs = 1;
+    }
+
+    // OPEN the old private key and new public key files.
+
+    FILE *pvfile = fopen(priv_file, "r");
+
+    if (pvfile == NULL) {
+        fprintf(stderr, "Error: Reencrypt could not access private key file.\n");
+        return 1;
+    }
+
+    FILE *pbfile = fopen(pub_file, "r");
+
+    if (pbfile == NULL) {
+        fprintf(stderr, "Error: Reencrypt could not access public key file.\n");
+        return 1;
+    }
+
+    // ENABLE per-block statistics if a statistics file was given.
+
+    FILE *stats_file = NULL;
+
+    if (stats_name != NULL) {
+        stats_file = fopen(stats_name, "w");
+        if (stats_file == NULL) {
+            fprintf(stderr, "Error: Reencrypt could not access statistics file.\n");
+            return 1;
+        }
+
+        stats_init();
+    }
+
+    // INITIALIZE multiple-precision variables and READ both keys.
+
+    mpz_inits(pq, d, n, NULL);
+
+    ss_read_priv(pq, d, pvfile);
+    ss_read_pub(n, username, pbfile);
+
+    fclose(pvfile);
+    fclose(pbfile);
+
+    // DO if verbose output is enabled.
+
+    if (verbose_output) {
+        gmp_fprintf(stdout, "pq (%d bits) = %Zd\n", mpz_sizeinbase(pq, 2), pq);
+        gmp_fprintf(stdout, "d (%d bits) = %Zd\n", mpz_sizeinbase(d, 2), d);
+        gmp_fprintf(stdout, "user = %s\n", username);
+        gmp_fprintf(stdout, "n (%d bits) = %Zd\n", mpz_sizeinbase(n, 2), n);
+    }
+
+    // IGNORE SIGPIPE, so a failed encrypting stage turns the decrypting stage's writes into errors.
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // RE-ENCRYPT the input, or every file of the batch.
+
+    bool reencrypted = batch_reencrypt(batch_name, in_name, out_name, d, pq, n, codec, jobs);
+
+    // CLEAR variables and WRITE per-block statistics.
+
+    mpz_clears(pq, d, n, NULL);
+
+    if (stats_file != NULL) {
+        stats_dump("reencrypt", stats_file);
+        fclose(stats_file);
+    }
+
+    return reencrypted ? 0 : 1;
+}
@@ -0,0 +1,332 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gmp.h>
+
+#include "ring.h"
+#include "ss.h"
+
+// A keyring file, in native byte order, is laid out as:
+//  header:  magic, count, slots, and the offsets of the sections below
+//  entries: per key its fingerprint, the offsets of its username and n, and their lengths
+//  indexes: two tables of 'slots' entry numbers (+ 1, 0 for empty), by username and fingerprint
+//  blob:    NUL-terminated usernames and big-endian bytes of n
+#define RING_MAGIC "SSRING01"
+
+typedef struct {
+    char magic[8];
+    uint64_t count;
+    uint64_t slots;
+    uint64_t entries_off;
+    uint64_t user_index_off;
+    uint64_t fingerprint_index_off;
+    uint64_t blob_off;
+    uint64_t blob_size;
+} RingHeader;
+
+typedef struct {
+    uint64_t fingerprint;
+    uint64_t name_off;
+    uint64_t n_off;
+    uint32_t name_len;
+    uint32_t n_len;
+} RingEntry;
+
+// HASHES a username with 64-bit FNV-1a.
+static uint64_t hash_name(const char *name) {
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (const char *c = name; *c != '\0'; c += 1) {
+        hash = (hash ^ (uint8_t) *c) * 0x100000001b3;
+    }
+
+    return hash;
+}
+
+// SPREADS a fingerprint over the table, since fingerprints are already hashes.
+static uint64_t hash_fingerprint(uint64_t fingerprint) {
+    return fingerprint ^ (fingerprint >> 29);
+}
+
+// READS the i-th entry of a mapped keyring.
+static RingEntry get_entry(const Keyring *ring, uint64_t i) {
+    RingEntry e;
+    memcpy(&e, ring->entries + i * sizeof(RingEntry), sizeof(RingEntry));
+
+    return e;
+}
+
+// CHECKS that 'num' items of 'item' bytes at 'off' end by 'limit', without overflowing.
+static bool section_fits(uint64_t off, uint64_t num, uint64_t item, uint64_t limit) {
+    return off <= limit && num <= (limit - off) / item;
+}
+
+// READS the i-th entry into 'e' if it exists, its username and n lie in the blob, and its
+// username is terminated and fits a login name, so a lookup never reads outside the map.
+static bool get_valid_entry(const Keyring *ring, uint64_t i, RingEntry *e) {
+    if (i >= ring->count) {
+        return false;
+    }
+
+    *e = get_entry(ring, i);
+
+    uint64_t blob_end = ring->blob_off + ring->blob_size;
+
+    return e->name_len < LOGIN_NAME_MAX && e->name_off >= ring->blob_off
+           && section_fits(e->name_off, (uint64_t) e->name_len + 1, 1, blob_end)
+           && ring->map[e->name_off + e->name_len] == '\0' && e->n_off >= ring->blob_off
+           && section_fits(e->n_off, e->n_len, 1, blob_end);
+}
+
+// COPIES the n and username of a valid entry.
+static void read_entry(const Keyring *ring, const RingEntry *e, mpz_t n, char username[]) {
+    mpz_import(n, e->n_len, 1, sizeof(uint8_t), 1, 0, ring->map + e->n_off);
+
+    if (username != NULL) {
+        memcpy(username, ring->map + e->name_off, e->name_len + 1);
+    }
+}
+
+// INSERTS entry 'e' into an index at 'hash', replacing an entry for which 'same' holds.
+static void index_insert(uint32_t *index, uint64_t slots, uint64_t hash, uint32_t e,
+    bool (*same)(uint32_t, uint32_t, void *), void *ctx) {
+    for (uint64_t s = hash & (slots - 1);; s = (s + 1) & (slots - 1)) {
+        if (index[s] == 0 || same(index[s] - 1, e, ctx)) {
+            index[s] = e + 1;
+            return;
+        }
+    }
+}
+
+typedef struct {
+    char **usernames;
+    uint64_t *fingerprints;
+} BuildKeys;
+
+static bool same_user(uint32_t a, uint32_t b, void *ctx) {
+    BuildKeys *keys = (BuildKeys *) ctx;
+
+    return strcmp(keys->usernames[a], keys->usernames[b]) == 0;
+}
+
+static bool same_fingerprint(uint32_t a, uint32_t b, void *ctx) {
+    BuildKeys *keys = (BuildKeys *) ctx;
+
+    return keys->fingerprints[a] == keys->fingerprints[b];
+}
+
+bool ring_write(mpz_t *n, char **usernames, uint64_t count, FILE *ringfile) {
+    // REFUSE keys that ring_open would reject.
+    if (count >= UINT32_MAX) {
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        if (strlen(usernames[i]) >= LOGIN_NAME_MAX) {
+            return false;
+        }
+    }
+
+    RingHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, RING_MAGIC, sizeof(hdr.magic));
+
+    // SIZE the indexes to at most half full, as a power of two.
+    hdr.count = count;
+    hdr.slots = 2;
+    while (hdr.slots < 2 * count) {
+        hdr.slots *= 2;
+    }
+
+    hdr.entries_off = sizeof(RingHeader);
+    hdr.user_index_off = hdr.entries_off + count * sizeof(RingEntry);
+    hdr.fingerprint_index_off = hdr.user_index_off + hdr.slots * sizeof(uint32_t);
+    hdr.blob_off = hdr.fingerprint_index_off + hdr.slots * sizeof(uint32_t);
+
+    RingEntry *entries = (RingEntry *) calloc(count, sizeof(RingEntry));
+    uint64_t *fingerprints = (uint64_t *) calloc(count, sizeof(uint64_t));
+    uint32_t *user_index = (uint32_t *) calloc(hdr.slots, sizeof(uint32_t));
+    uint32_t *fingerprint_index = (uint32_t *) calloc(hdr.slots, sizeof(uint32_t));
+
+    BuildKeys keys = { usernames, fingerprints };
+
+    // LAY OUT the blob and BUILD both indexes.
+    uint64_t blob = hdr.blob_off;
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        fingerprints[i] = ss_fingerprint(n[i]);
+
+        entries[i].fingerprint = fingerprints[i];
+        entries[i].name_len = strlen(usernames[i]);
+        entries[i].name_off = blob;
+        blob += entries[i].name_len + 1;
+        entries[i].n_len = (mpz_sizeinbase(n[i], 2) + 7) / 8;
+        entries[i].n_off = blob;
+        blob += entries[i].n_len;
+
+        index_insert(user_index, hdr.slots, hash_name(usernames[i]), i, same_user, &keys);
+        index_insert(fingerprint_index, hdr.slots, hash_fingerprint(fingerprints[i]), i,
+            same_fingerprint, &keys);
+    }
+
+    hdr.blob_size = blob - hdr.blob_off;
+
+    // WRITE every section in order.
+    fwrite(&hdr, sizeof(hdr), 1, ringfile);
+    fwrite(entries, sizeof(RingEntry), count, ringfile);
+    fwrite(user_index, sizeof(uint32_t), hdr.slots, ringfile);
+    fwrite(fingerprint_index, sizeof(uint32_t), hdr.slots, ringfile);
+
+    uint8_t *bytes = (uint8_t *) malloc(1);
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        size_t len = 0;
+
+        bytes = (uint8_t *) realloc(bytes, entries[i].n_len + 1);
+        mpz_export(bytes, &len, 1, sizeof(uint8_t), 1, 0, n[i]);
+
+        fwrite(usernames[i], sizeof(char), entries[i].name_len + 1, ringfile);
+        fwrite(bytes, sizeof(uint8_t), len, ringfile);
+    }
+
+    free(bytes);
+    free(entries);
+    free(fingerprints);
+    free(user_index);
+    free(fingerprint_index);
+
+    return fflush(ringfile) == 0 && ferror(ringfile) == 0;
+}
+
+bool ring_open(Keyring *ring, const char *ring_file) {
+    memset(ring, 0, sizeof(Keyring));
+
+    int fd = open(ring_file, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(RingHeader)) {
+        close(fd);
+        return false;
+    }
+
+    ring->size = st.st_size;
+    ring->map = (uint8_t *) mmap(NULL, ring->size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return false;
+    }
+
+    RingHeader hdr;
+    memcpy(&hdr, ring->map, sizeof(hdr));
+
+    // CHECK that the sections are in order, aligned, and inside the file.
+    uint64_t index_bytes = sizeof(uint32_t);
+
+    bool valid = memcmp(hdr.magic, RING_MAGIC, sizeof(hdr.magic)) == 0 && hdr.count < UINT32_MAX
+                 && hdr.slots >= 2 && hdr.slots / 2 >= hdr.count
+                 && (hdr.slots & (hdr.slots - 1)) == 0
+                 && hdr.user_index_off % index_bytes == 0
+                 && hdr.fingerprint_index_off % index_bytes == 0
+                 && section_fits(hdr.entries_off, hdr.count, sizeof(RingEntry), hdr.user_index_off)
+                 && section_fits(
+                     hdr.user_index_off, hdr.slots, index_bytes, hdr.fingerprint_index_off)
+                 && section_fits(hdr.fingerprint_index_off, hdr.slots, index_bytes, hdr.blob_off)
+                 && section_fits(hdr.blob_off, hdr.blob_size, 1, ring->size);
+
+    ring->count = hdr.count;
+    ring->slots = hdr.slots;
+    ring->blob_off = hdr.blob_off;
+    ring->blob_size = hdr.blob_size;
+    ring->entries = ring->map + hdr.entries_off;
+    ring->user_index = (const uint32_t *) (ring->map + hdr.user_index_off);
+    ring->fingerprint_index = (const uint32_t *) (ring->map + hdr.fingerprint_index_off);
+
+    if (!valid) {
+        ring_close(ring);
+        return false;
+    }
+
+    return true;
+}
+
+void ring_close(Keyring *ring) {
+    if (ring->map != NULL) {
+        munmap(ring->map, ring->size);
+    }
+
+    memset(ring, 0, sizeof(Keyring));
+}
+
+bool ring_entry(const Keyring *ring, uint64_t i, mpz_t n, char username[]) {
+    RingEntry e;
+
+    if (!get_valid_entry(ring, i, &e)) {
+        return false;
+    }
+
+    read_entry(ring, &e, n, username);
+
+    return true;
+}
+
+bool ring_find_user(const Keyring *ring, const char *username, mpz_t n) {
+    uint64_t mask = ring->slots - 1;
+    uint64_t s = hash_name(username) & mask;
+
+    // PROBE from the username's slot until it or an empty slot turns up, checking only the
+    // entries on the way, and at most every slot once.
+    for (uint64_t probes = 0; probes < ring->slots && ring->user_index[s] != 0; probes += 1) {
+        RingEntry e;
+
+        if (!get_valid_entry(ring, ring->user_index[s] - 1, &e)) {
+            return false;
+        }
+
+        if (strcmp((const char *) ring->map + e.name_off, username) == 0) {
+            read_entry(ring, &e, n, NULL);
+            return true;
+        }
+
+        s = (s + 1) & mask;
+    }
+
+    return false;
+}
+
+bool ring_find_fingerprint(const Keyring *ring, uint64_t fingerprint, mpz_t n, char username[]) {
+    uint64_t mask = ring->slots - 1;
+    uint64_t s = hash_fingerprint(fingerprint) & mask;
+
+    for (uint64_t probes = 0; probes < ring->slots && ring->fingerprint_index[s] != 0;
+         probes += 1) {
+        RingEntry e;
+
+        if (!get_valid_entry(ring, ring->fingerprint_index[s] - 1, &e)) {
+            return false;
+        }
+
+        if (e.fingerprint == fingerprint) {
+            read_entry(ring, &e, n, username);
+            return true;
+        }
+
+        s = (s + 1) & mask;
+    }
+
+    return false;
+}
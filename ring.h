@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Memory-mapped keyring of SS public keys, indexed by username and by key
+// fingerprint (see ss_fingerprint) with open-addressing hash tables.
+//
+typedef struct {
+    uint8_t *map;
+    size_t size;
+    uint64_t count;
+    uint64_t slots;
+    uint64_t blob_off;
+    uint64_t blob_size;
+    const uint8_t *entries;
+    const uint32_t *user_index;
+    const uint32_t *fingerprint_index;
+} Keyring;
+
+//
+// Writes a keyring holding 'count' public keys.
+// When a username or fingerprint repeats, lookups find the last key given for it.
+//
+// Requires:
+//  n: public moduli
+//  usernames: login names of the keyholders
+//  ringfile: open and writable file stream
+//
+// Returns false if the keyring could not be written, or a username has
+// LOGIN_NAME_MAX or more characters.
+//
+bool ring_write(mpz_t *n, char **usernames, uint64_t count, FILE *ringfile);
+
+//
+// Maps a keyring file into memory and checks, in O(1), that its header is a
+// keyring's and that every section lies inside the file. Entries are checked
+// by the lookups that touch them, so opening a large keyring stays cheap.
+//
+// Returns false if the file is missing, is not a keyring, or a section does
+// not fit.
+//
+bool ring_open(Keyring *ring, const char *ring_file);
+
+//
+// Unmaps a keyring.
+//
+void ring_close(Keyring *ring);
+
+//
+// Looks up the public key of a user.
+//
+// Provides:
+//  n: public modulus
+//
+// Requires:
+//  n: initialized mpz_t
+//
+// Returns false if the user has no key in the keyring, or the lookup met a
+// corrupt index slot or entry.
+//
+bool ring_find_user(const Keyring *ring, const char *username, mpz_t n);
+
+//
+// Looks up a public key by its fingerprint.
+//
+// Provides:
+//  n: public modulus
+//  username: $USER of the keyholder
+//
+// Requires:
+//  username: requires sufficient space
+//  n: initialized mpz_t
+//
+// Returns false if no key has the fingerprint, or the lookup met a corrupt
+// index slot or entry.
+//
+bool ring_find_fingerprint(const Keyring *ring, uint64_t fingerprint, mpz_t n, char username[]);
+
+//
+// Reads the i-th key of a keyring, for listing its contents.
+//
+// Provides:
+//  n: public modulus
+//  username: $USER of the keyholder
+//
+// Requires:
+//  username: requires sufficient space
+//  n: initialized mpz_t
+//
+// Returns false if there is no i-th key, or its entry is corrupt.
+//
+bool ring_entry(const Keyring *ring, uint64_t i, mpz_t n, char username[]);
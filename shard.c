@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "shard.h"
+
+#define MANIFEST_MAGIC "#ss-shards"
+
+typedef struct {
+    FILE *file;
+    uint64_t left;
+} Limit;
+
+// RETURNS the file name part of a path.
+static const char *base_name(const char *path) {
+    const char *slash = strrchr(path, '/');
+
+    return slash == NULL ? path : slash + 1;
+}
+
+void shard_plan(Manifest *m, const char *manifest_file, uint64_t fingerprint, uint64_t size,
+    uint64_t block, uint64_t count) {
+    m->fingerprint = fingerprint;
+    m->size = size;
+    m->block = block;
+    m->count = count;
+    m->shards = (Shard *) calloc(count, sizeof(Shard));
+
+    // COMPUTE whole blocks per shard, rounding up so shards are as even as possible.
+    uint64_t blocks = (size + block - 1) / block;
+    uint64_t per_shard = ((blocks + count - 1) / count) * block;
+
+    const char *name = base_name(manifest_file);
+
+    for (uint64_t i = 0; i < count; i += 1) {
+        uint64_t offset = i * per_shard < size ? i * per_shard : size;
+        uint64_t end = offset + per_shard < size ? offset + per_shard : size;
+
+        m->shards[i].offset = offset;
+        m->shards[i].length = end - offset;
+        m->shards[i].file = (char *) malloc(strlen(name) + 24);
+        sprintf(m->shards[i].file, "%s.%lu", name, i);
+    }
+}
+
+bool shard_write_manifest(const Manifest *m, const char *manifest_file) {
+    char *tmp = (char *) malloc(strlen(manifest_file) + 32);
+    sprintf(tmp, "%s.%d.tmp", manifest_file, (int) getpid());
+
+    FILE *mfile = fopen(tmp, "w");
+
+    if (mfile == NULL) {
+        free(tmp);
+        return false;
+    }
+
+    fprintf(mfile, "%s\n", MANIFEST_MAGIC);
+    fprintf(mfile, "fingerprint %016lx\n", m->fingerprint);
+    fprintf(mfile, "size %lu\nblock %lu\nshards %lu\n", m->size, m->block, m->count);
+
+    for (uint64_t i = 0; i < m->count; i += 1) {
+        fprintf(mfile, "%lu %lu %lu %s\n", i, m->shards[i].offset, m->shards[i].length,
+            m->shards[i].file);
+    }
+
+    bool written = fclose(mfile) == 0 && rename(tmp, manifest_file) == 0;
+
+    free(tmp);
+
+    return written;
+}
+
+bool shard_read_manifest(Manifest *m, const char *manifest_file) {
+    FILE *mfile = fopen(manifest_file, "r");
+
+    memset(m, 0, sizeof(Manifest));
+
+    if (mfile == NULL) {
+        return false;
+    }
+
+    char magic[16] = "";
+    bool valid = fscanf(mfile, "%15s fingerprint %lx size %lu block %lu shards %lu", magic,
+                     &m->fingerprint, &m->size, &m->block, &m->count)
+                     == 5
+                 && strcmp(magic, MANIFEST_MAGIC) == 0 && m->count > 0;
+
+    if (valid) {
+        m->shards = (Shard *) calloc(m->count, sizeof(Shard));
+    }
+
+    for (uint64_t i = 0; valid && i < m->count; i += 1) {
+        uint64_t index;
+        char file[4096];
+
+        valid = fscanf(mfile, "%lu %lu %lu %4095s", &index, &m->shards[i].offset,
+                    &m->shards[i].length, file)
+                    == 4
+                && index == i;
+
+        m->shards[i].file = valid ? strdup(file) : NULL;
+    }
+
+    fclose(mfile);
+
+    if (!valid) {
+        shard_clear(m);
+    }
+
+    return valid;
+}
+
+char *shard_path(const char *manifest_file, const Shard *shard) {
+    size_t dir_len = base_name(manifest_file) - manifest_file;
+    char *path = (char *) malloc(dir_len + strlen(shard->file) + 1);
+
+    memcpy(path, manifest_file, dir_len);
+    strcpy(path + dir_len, shard->file);
+
+    return path;
+}
+
+static ssize_t limit_read(void *cookie, char *buf, size_t size) {
+    Limit *l = (Limit *) cookie;
+    size_t n = fread(buf, sizeof(char), size < l->left ? size : l->left, l->file);
+
+    l->left -= n;
+
+    return ferror(l->file) ? -1 : (ssize_t) n;
+}
+
+static int limit_close(void *cookie) {
+    free(cookie);
+
+    return 0;
+}
+
+FILE *shard_reader(FILE *infile, uint64_t length) {
+    Limit *l = (Limit *) malloc(sizeof(Limit));
+
+    if (l == NULL) {
+        return NULL;
+    }
+
+    l->file = infile;
+    l->left = length;
+
+    cookie_io_functions_t io = { .read = limit_read, .close = limit_close };
+
+    return fopencookie(l, "r", io);
+}
+
+void shard_clear(Manifest *m) {
+    for (uint64_t i = 0; m->shards != NULL && i < m->count; i += 1) {
+        free(m->shards[i].file);
+    }
+
+    free(m->shards);
+    m->shards = NULL;
+    m->count = 0;
+}
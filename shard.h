@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// One shard of a sharded ciphertext: a block-aligned plaintext range and
+// the file holding its encryption.
+//
+typedef struct {
+    uint64_t offset;
+    uint64_t length;
+    char *file;
+} Shard;
+
+//
+// Manifest of a sharded ciphertext.
+// Concatenating the shard files in order gives the plain, unsharded ciphertext.
+// encrypt -x -I refuses to overwrite a manifest whose fingerprint, size, block
+// or count differ from its own plan. Decryption only holds the private key, so
+// it cannot check the fingerprint.
+//
+typedef struct {
+    uint64_t fingerprint;
+    uint64_t size;
+    uint64_t block;
+    uint64_t count;
+    Shard *shards;
+} Manifest;
+
+//
+// Splits 'size' plaintext bytes into 'count' shards on 'block'-byte boundaries.
+// Shard i is stored next to the manifest as "<manifest name>.i".
+//
+// Provides:
+//  m: the planned manifest, to be freed with shard_clear
+//
+// Requires:
+//  manifest_file: path the manifest will be written to
+//  fingerprint: fingerprint of the public key (see ss_fingerprint)
+//  block: plaintext bytes per SS block
+//  count: # of shards, at least 1
+//
+void shard_plan(Manifest *m, const char *manifest_file, uint64_t fingerprint, uint64_t size,
+    uint64_t block, uint64_t count);
+
+//
+// Writes a manifest through a temporary file, so processes writing the same
+// manifest concurrently never leave a mix of both behind.
+//
+// Returns false if the manifest could not be written.
+//
+bool shard_write_manifest(const Manifest *m, const char *manifest_file);
+
+//
+// Reads a manifest written by shard_write_manifest.
+//
+// Returns false if the manifest could not be read.
+//
+bool shard_read_manifest(Manifest *m, const char *manifest_file);
+
+//
+// Builds the path of a shard file relative to the directory of its manifest.
+//
+// Returns a newly allocated string.
+//
+char *shard_path(const char *manifest_file, const Shard *shard);
+
+//
+// Wraps a stream in a read stream that ends after 'length' more bytes.
+//
+// Requires:
+//  infile: open and readable file stream, positioned at the shard (left open on close)
+//
+// Returns NULL on failure.
+//
+FILE *shard_reader(FILE *infile, uint64_t length);
+
+//
+// Frees the memory held by a manifest.
+//
+void shard_clear(Manifest *m);
@@ -6,39 +6,53 @@
 #include "ss.h"
 #include "randstate.h"
 #include "numtheory.h"
+#include "pool.h"
+#include "compress.h"
+#include "stats.h"
+
+// TAKES a prime of 'bits' bits from the prime pool, or SEARCHES for one if the pool has none.
+static void draw_prime(mpz_t p, uint64_t bits, uint64_t iters) {
+    if (!pool_take(p, bits)) {
+        make_prime(p, bits, iters);
+    }
+}
+
+uint64_t ss_q_bits(uint64_t nbits, uint64_t p_bits) {
+    // p^2 >= 2^(2 * p_bits - 2) and q >= 2^(q_bits - 1), so this makes n >= 2^(nbits - 1).
+    return nbits - (2 * p_bits) + 2;
+}
 
 void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters) {
-    mpz_t p_squared, p_minus_1, q_minus_1, p_mod_q, q_mod_p;
+    mpz_t p_minus_1, q_minus_1, p_mod_q, q_mod_p;
 
     // INITIALIZE mpz objects.
-    mpz_inits(p_squared, p_minus_1, q_minus_1, p_mod_q, q_mod_p, NULL);
+    mpz_inits(p_minus_1, q_minus_1, p_mod_q, q_mod_p, NULL);
 
-    // LOOP while log(n) < 2 OR p is not divisible by (q - 1) OR q is not divisible by (p - 1).
-    do {
-        // COMPUTE p bits and q bits.
-        uint64_t p_bits = (random() % (((2 * nbits) / 5) - (nbits / 5))) + (nbits / 5);
-        uint64_t q_bits = nbits - (2 * p_bits);
+    // COMPUTE p bits and q bits. q is sized so that n has at least nbits bits by construction.
+    uint64_t p_bits = randstate_uniform(((2 * nbits) / 5) - (nbits / 5)) + (nbits / 5);
+    uint64_t q_bits = ss_q_bits(nbits, p_bits);
+
+    // MAKE prime p once; it is kept for every q candidate.
+    draw_prime(p, p_bits, iters);
+    mpz_sub_ui(p_minus_1, p, 1);
 
-        // MAKE primes p and q.
-        make_prime(p, p_bits, iters);
-        make_prime(q, q_bits, iters);
+    // LOOP drawing q while q equals p OR p divides (q - 1) OR q divides (p - 1).
+    do {
+        draw_prime(q, q_bits, iters);
 
-        // COMPUTE p % (q - 1) and q % (p - 1).
-        mpz_sub_ui(p_minus_1, p, 1);
         mpz_sub_ui(q_minus_1, q, 1);
 
-        mpz_mod(p_mod_q, p, q_minus_1);
-        mpz_mod(q_mod_p, q, p_minus_1);
+        mpz_mod(p_mod_q, q_minus_1, p);
+        mpz_mod(q_mod_p, p_minus_1, q);
 
-        // COMPUTE key n.
-        mpz_mul(p_squared, p, p);
-        mpz_mul(n, p_squared, q);
+    } while (mpz_cmp(p, q) == 0 || mpz_cmp_ui(p_mod_q, 0) == 0 || mpz_cmp_ui(q_mod_p, 0) == 0);
 
-    } while (
-        mpz_sizeinbase(n, 2) < nbits || mpz_cmp_ui(p_mod_q, 0) == 0 || mpz_cmp_ui(p_mod_q, 0) == 0);
+    // COMPUTE key n.
+    mpz_mul(n, p, p);
+    mpz_mul(n, n, q);
 
     // DEALLOCATE mpz objects.
-    mpz_clears(p_squared, p_minus_1, q_minus_1, p_mod_q, q_mod_p, NULL);
+    mpz_clears(p_minus_1, q_minus_1, p_mod_q, q_mod_p, NULL);
 }
 
 void ss_write_pub(const mpz_t n, const char username[], FILE *pbfile) {
@@ -49,6 +63,24 @@ void ss_read_pub(mpz_t n, char username[], FILE *pbfile) {
     gmp_fscanf(pbfile, "%Zx\n%s\n", n, username);
 }
 
+uint64_t ss_fingerprint(const mpz_t n) {
+    size_t count;
+
+    // EXPORT n as big-endian bytes and HASH them with 64-bit FNV-1a.
+    uint8_t *bytes = (uint8_t *) mpz_export(NULL, &count, 1, sizeof(uint8_t), 1, 0, n);
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for (size_t i = 0; i < count; i += 1) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3;
+    }
+
+    void (*free_func)(void *, size_t);
+    mp_get_memory_functions(NULL, NULL, &free_func);
+    free_func(bytes, count);
+
+    return hash;
+}
+
 void ss_make_priv(mpz_t d, mpz_t pq, const mpz_t p, const mpz_t q) {
     mpz_t n, p_minus_1, q_minus_1, lambda, numerator, denominator;
 
@@ -87,19 +119,30 @@ void ss_encrypt(mpz_t c, const mpz_t m, const mpz_t n) {
     pow_mod(c, m, n, n);
 }
 
+uint64_t ss_block_size(const mpz_t n) {
+    mpz_t sqrt_n;
+    mpz_init(sqrt_n);
+
+    // COMPUTE the square root of n.
+    mpz_sqrt(sqrt_n, n);
+
+    uint64_t k = (mpz_sizeinbase(sqrt_n, 2) - 1) / 8;
+
+    mpz_clear(sqrt_n);
+
+    return k;
+}
+
 void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n) {
-    mpz_t m, sqrt_n, encrypted_num;
+    mpz_t m, encrypted_num;
 
     // INITIALIZE mpz objects.
-    mpz_inits(m, sqrt_n, encrypted_num, NULL);
+    mpz_inits(m, encrypted_num, NULL);
 
     size_t j;
 
-    // COMPUTE the square root of n.
-    mpz_sqrt(sqrt_n, n);
-
     // COMPUTE block size k.
-    uint64_t k = (mpz_sizeinbase(sqrt_n, 2) - 1) / 8;
+    uint64_t k = ss_block_size(n);
 
     // Dynamically ALLOCATE an array that holds k blocks.
     uint8_t *block = (uint8_t *) malloc(k * sizeof(uint8_t));
@@ -107,24 +150,54 @@ void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n) {
     // SET the zeroth byte of the block to 0xFF.
     block[0] = 0xFF;
 
-    // LOOP while there are still unprocessed bytes in 'infile'.
-    while (feof(infile) == 0) {
+    // LOOP while there are still unprocessed bytes in 'infile', and it can still be read.
+    while (feof(infile) == 0 && ferror(infile) == 0) {
+        uint64_t t = stats_now();
+
         j = fread(block + 1, sizeof(uint8_t), k - 1, infile);
+        SS_TRACE(encrypt_block_start);
+        t = stats_lap(STAGE_READ, t);
+
         mpz_import(m, j + 1, 1, sizeof(uint8_t), 1, 0, block);
         ss_encrypt(encrypted_num, m, n);
+        t = stats_lap(STAGE_CRYPT, t);
+
         gmp_fprintf(outfile, "%Zx\n", encrypted_num);
+        stats_lap(STAGE_WRITE, t);
+        stats_block(j);
+        SS_TRACE1(encrypt_block_done, j);
     }
 
     // DEALLOCATE both, variables and block.
     free(block);
-    mpz_clears(m, sqrt_n, encrypted_num, NULL);
+    mpz_clears(m, encrypted_num, NULL);
+}
+
+bool ss_encrypt_file_compressed(FILE *infile, FILE *outfile, const mpz_t n, Codec codec) {
+    FILE *compressed = compress_reader(infile, codec);
+
+    if (compressed == NULL) {
+        fprintf(stderr, "Error: Could not start %s compression.\n", compress_codec_name(codec));
+        return false;
+    }
+
+    // MARK the codec in a header line, which can never be mistaken for a hex block.
+    fprintf(outfile, "#%s\n", compress_codec_name(codec));
+
+    ss_encrypt_file(compressed, outfile, n);
+
+    bool compressed_ok = ferror(compressed) == 0;
+
+    fclose(compressed);
+
+    return compressed_ok && ferror(infile) == 0;
 }
 
 void ss_decrypt(mpz_t m, const mpz_t c, const mpz_t d, const mpz_t pq) {
     pow_mod(m, c, d, pq);
 }
 
-void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq) {
+bool ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq) {
     mpz_t c, m;
 
     /// INITIALIZE mpz objects.
@@ -132,24 +205,86 @@ void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq)
 
     size_t j;
 
-    // COMPUTE block size k..
-    uint64_t k = (mpz_sizeinbase(pq, 2) - 1) / 8;
-
-    // Dynamically ALLOCATE an array that holds k blocks.
-    uint8_t *block = (uint8_t *) malloc(k * sizeof(uint8_t));
+    // Dynamically ALLOCATE an array that holds any m below pq, even from a foreign key.
+    uint8_t *block = (uint8_t *) malloc((mpz_sizeinbase(pq, 2) + 7) / 8 * sizeof(uint8_t));
 
     // SET the zeroth byte of the block to 0xFF.
     block[0] = 0xFF;
 
+    // CHECK for a compression header and, if present, DECOMPRESS blocks on their way out.
+    FILE *sink = outfile;
+    int first = fgetc(infile);
+
+    if (first == '#') {
+        char name[16] = "";
+        Codec codec = CODEC_NONE;
+
+        if (fscanf(infile, "%15s\n", name) == 1) {
+            codec = compress_codec_from_name(name);
+        }
+
+        if (codec != CODEC_NONE) {
+            sink = decompress_writer(outfile, codec);
+        }
+
+        if (codec == CODEC_NONE || sink == NULL) {
+            fprintf(stderr, "Error: Unsupported compression '%s' in ciphertext.\n", name);
+            free(block);
+            mpz_clears(c, m, NULL);
+            return false;
+        }
+    } else if (first != EOF) {
+        ungetc(first, infile);
+    }
+
+    bool written = true;
+
     // LOOP while there are still unprocessed bytes in 'infile'.
-    while (feof(infile) == 0) {
-        gmp_fscanf(infile, "%Zx\n", c);
+    while (feof(infile) == 0 && written) {
+        uint64_t t = stats_now();
+
+        // STOP cleanly if no block is left, e.g. for an empty incremental ciphertext;
+        // anything else that is not a hex block is malformed.
+        int scanned = gmp_fscanf(infile, "%Zx\n", c);
+
+        if (scanned == EOF && feof(infile) && ferror(infile) == 0) {
+            break;
+        }
+
+        if (scanned != 1) {
+            fprintf(stderr, "Error: Malformed ciphertext block.\n");
+            written = false;
+            break;
+        }
+
+        SS_TRACE(decrypt_block_start);
+        t = stats_lap(STAGE_READ, t);
+
         ss_decrypt(m, c, d, pq);
         mpz_export(block, &j, 1, sizeof(uint8_t), 1, 0, m);
-        fwrite(block + 1, sizeof(uint8_t), j - 1, outfile);
+        t = stats_lap(STAGE_CRYPT, t);
+
+        // CHECK the 0xFF marker every block starts with, which a wrong private key destroys.
+        if (j == 0 || block[0] != 0xFF) {
+            fprintf(stderr, "Error: Ciphertext block does not decrypt under this private key.\n");
+            written = false;
+            break;
+        }
+
+        written = fwrite(block + 1, sizeof(uint8_t), j - 1, sink) == j - 1;
+        stats_lap(STAGE_WRITE, t);
+        stats_block(j - 1);
+        SS_TRACE1(decrypt_block_done, j - 1);
+    }
+
+    // CLOSE the decompressor, which fails on corrupt or truncated compressed data.
+    if (sink != outfile && fclose(sink) != 0) {
+        written = false;
     }
 
     // DEALLOCATE both, variables and block.
     free(block);
     mpz_clears(c, m, NULL);
+
+    return written;
 }
@@ -5,6 +5,14 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "compress.h"
+
+//
+// Computes the # of bits in q for a p of p_bits bits, chosen so that
+// n = p * p * q always has at least nbits bits.
+//
+uint64_t ss_q_bits(uint64_t nbits, uint64_t p_bits);
+
 //
 // Generates the components for a new SS key.
 //
@@ -18,6 +26,10 @@
 //  iters: iterations of Miller-Rabin to use for primality check
 //  all mpz_t arguments to be initialized
 //
+// p is drawn once; only q is redrawn until p does not divide q - 1
+// and q does not divide p - 1.
+// Primes are taken from the prime pool when one is open (see pool.h).
+//
 void ss_make_pub(mpz_t p, mpz_t q, mpz_t n, uint64_t nbits, uint64_t iters);
 
 //
@@ -68,6 +80,16 @@ void ss_write_priv(const mpz_t pq, const mpz_t d, FILE *pvfile);
 //
 void ss_read_pub(mpz_t n, char username[], FILE *pbfile);
 
+//
+// Compute a short fingerprint identifying an SS public key
+//
+// Requires:
+//  n: public modulus
+//
+// Returns a 64-bit FNV-1a hash of the bytes of n.
+//
+uint64_t ss_fingerprint(const mpz_t n);
+
 //
 // Import SS private key from input stream
 //
@@ -94,6 +116,15 @@ void ss_read_priv(mpz_t pq, mpz_t d, FILE *pvfile);
 //
 void ss_encrypt(mpz_t c, const mpz_t m, const mpz_t n);
 
+//
+// Compute the block size k used by ss_encrypt_file
+// Each block carries k - 1 bytes of plaintext behind a 0xFF marker byte.
+//
+// Requires:
+//  n: public exponent and modulus
+//
+uint64_t ss_block_size(const mpz_t n);
+
 //
 // Encrypt an arbitrary file
 //
@@ -107,6 +138,23 @@ void ss_encrypt(mpz_t c, const mpz_t m, const mpz_t n);
 //
 void ss_encrypt_file(FILE *infile, FILE *outfile, const mpz_t n);
 
+//
+// Compress and then encrypt an arbitrary file
+//
+// Provides:
+//  fills outfile with a codec header line followed by the encrypted,
+//  compressed contents of infile; ss_decrypt_file undoes both
+//
+// Requires:
+//  infile: open and readable file stream
+//  outfile: open and writable file stream
+//  n: public exponent and modulus
+//  codec: CODEC_LZ or CODEC_ZLIB (see compress.h)
+//
+// Returns false if compression could not start or reading infile failed.
+//
+bool ss_encrypt_file_compressed(FILE *infile, FILE *outfile, const mpz_t n, Codec codec);
+
 //
 // Decrypt number c into number m
 //
@@ -125,7 +173,8 @@ void ss_decrypt(mpz_t m, const mpz_t c, const mpz_t d, const mpz_t pq);
 // Decrypt a file back into its original form.
 //
 // Provides:
-//  fills outfile with the unencrypted data from infile
+//  fills outfile with the unencrypted data from infile,
+//  decompressing it if infile starts with a codec header
 //
 // Requires:
 //  infile: open and readable file stream to encrypted data
@@ -133,4 +182,8 @@ void ss_decrypt(mpz_t m, const mpz_t c, const mpz_t d, const mpz_t pq);
 //  d: private exponent
 //  pq: private modulus
 //
-void ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq);
+// Returns false if a block is malformed or does not decrypt under this key, the
+// compression is unsupported, or writing, or decompressing into, outfile failed.
+// Running out of blocks at the end of infile is a clean end.
+//
+bool ss_decrypt_file(FILE *infile, FILE *outfile, const mpz_t d, const mpz_t pq);
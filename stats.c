@@ -0,0 +1,161 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stats.h"
+
+// Histograms are log-linear like HdrHistogram: values below 16 get a bucket each,
+// and every power of two above that is split into 16 equal buckets, which keeps
+// each recorded value within 1/16 of its bucket's lower bound.
+#define SUB_BITS    4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define NUM_BUCKETS (SUB_BUCKETS + (64 - SUB_BITS) * SUB_BUCKETS)
+
+typedef struct {
+    uint64_t buckets[NUM_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} Histogram;
+
+bool stats_enabled = false;
+_Thread_local bool stats_ignored = false;
+
+static Histogram histograms[STAGE_COUNT];
+static uint64_t blocks;
+static uint64_t bytes;
+static uint64_t started;
+
+static const char *stage_names[STAGE_COUNT] = { "read", "crypt", "write" };
+
+// RETURNS the monotonic clock in nanoseconds.
+static uint64_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// MAPS a value to its histogram bucket.
+static size_t bucket_index(uint64_t v) {
+    if (v < SUB_BUCKETS) {
+        return v;
+    }
+
+    size_t mag = 63 - __builtin_clzll(v);
+
+    size_t sub = (v >> (mag - SUB_BITS)) & (SUB_BUCKETS - 1);
+
+    return SUB_BUCKETS + (mag - SUB_BITS) * SUB_BUCKETS + sub;
+}
+
+// MAPS a bucket back to the midpoint of the values it holds.
+static uint64_t bucket_value(size_t i) {
+    if (i < SUB_BUCKETS) {
+        return i;
+    }
+
+    size_t mag = (i - SUB_BUCKETS) / SUB_BUCKETS + SUB_BITS;
+    uint64_t sub = (i - SUB_BUCKETS) % SUB_BUCKETS;
+    uint64_t width = (uint64_t) 1 << (mag - SUB_BITS);
+
+    return ((SUB_BUCKETS + sub) << (mag - SUB_BITS)) + width / 2;
+}
+
+// RETURNS the value at quantile 'q' of a histogram.
+static uint64_t percentile(const Histogram *h, double q) {
+    uint64_t rank = (uint64_t) (q * h->count + 0.5);
+    uint64_t seen = 0;
+
+    rank = rank < 1 ? 1 : rank;
+
+    for (size_t i = 0; i < NUM_BUCKETS; i += 1) {
+        seen += h->buckets[i];
+
+        if (seen >= rank) {
+            uint64_t v = bucket_value(i);
+            return v < h->min ? h->min : (v > h->max ? h->max : v);
+        }
+    }
+
+    return h->max;
+}
+
+void stats_init(void) {
+    for (size_t s = 0; s < STAGE_COUNT; s += 1) {
+        histograms[s].min = UINT64_MAX;
+    }
+
+    started = clock_ns();
+    stats_enabled = true;
+}
+
+void stats_ignore_thread(void) {
+    stats_ignored = true;
+}
+
+uint64_t stats_clock(void) {
+    return clock_ns();
+}
+
+uint64_t stats_record(Stage stage, uint64_t start) {
+    uint64_t now = clock_ns();
+    uint64_t v = now - start;
+    Histogram *h = &histograms[stage];
+
+    // UPDATE atomically, since fan-out encryption records from several threads.
+    __atomic_fetch_add(&h->buckets[bucket_index(v)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&h->sum, v, __ATOMIC_RELAXED);
+
+    uint64_t seen = __atomic_load_n(&h->min, __ATOMIC_RELAXED);
+    while (v < seen
+           && !__atomic_compare_exchange_n(
+               &h->min, &seen, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    seen = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+    while (v > seen
+           && !__atomic_compare_exchange_n(
+               &h->max, &seen, v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+
+    return now;
+}
+
+void stats_count(uint64_t block_bytes) {
+    __atomic_fetch_add(&blocks, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&bytes, block_bytes, __ATOMIC_RELAXED);
+}
+
+void stats_dump(const char *program, FILE *statsfile) {
+    double seconds = (clock_ns() - started) / 1e9;
+
+    fprintf(statsfile, "{\n  \"program\": \"%s\",\n", program);
+    fprintf(statsfile, "  \"blocks\": %lu,\n  \"bytes\": %lu,\n", blocks, bytes);
+    fprintf(statsfile, "  \"seconds\": %.6f,\n", seconds);
+    fprintf(statsfile, "  \"mb_per_s\": %.3f,\n", seconds > 0 ? bytes / 1e6 / seconds : 0.0);
+    fprintf(statsfile, "  \"stages\": {\n");
+
+    for (size_t s = 0; s < STAGE_COUNT; s += 1) {
+        const Histogram *h = &histograms[s];
+
+        fprintf(statsfile, "    \"%s\": {\"count\": %lu", stage_names[s], h->count);
+
+        if (h->count > 0) {
+            fprintf(statsfile, ", \"min_ns\": %lu, \"mean_ns\": %lu", h->min, h->sum / h->count);
+            fprintf(statsfile, ", \"p50_ns\": %lu, \"p90_ns\": %lu", percentile(h, 0.50),
+                percentile(h, 0.90));
+            fprintf(statsfile, ", \"p99_ns\": %lu, \"p999_ns\": %lu", percentile(h, 0.99),
+                percentile(h, 0.999));
+            fprintf(statsfile, ", \"max_ns\": %lu", h->max);
+        }
+
+        fprintf(statsfile, "}%s\n", s + 1 < STAGE_COUNT ? "," : "");
+    }
+
+    fprintf(statsfile, "  }\n}\n");
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Static tracepoints around the SS block loops, for perf and bpftrace.
+// They compile to a single nop when <sys/sdt.h> is available, and to
+// nothing otherwise.
+//
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SS_TRACE(name)     DTRACE_PROBE(ss, name)
+#define SS_TRACE1(name, a) DTRACE_PROBE1(ss, name, a)
+#endif
+#endif
+
+#ifndef SS_TRACE
+#define SS_TRACE(name)     ((void) 0)
+#define SS_TRACE1(name, a) ((void) 0)
+#endif
+
+//
+// Stages of a block that get their own latency histogram.
+//
+typedef enum { STAGE_READ, STAGE_CRYPT, STAGE_WRITE, STAGE_COUNT } Stage;
+
+extern bool stats_enabled;
+
+// Set in threads whose blocks are left out of the statistics.
+extern _Thread_local bool stats_ignored;
+
+//
+// Enables per-block statistics and starts the wall clock for throughput.
+// Until this is called, every other stats function returns right away.
+//
+void stats_init(void);
+
+//
+// Leaves every later block of the calling thread out of the statistics.
+//
+void stats_ignore_thread(void);
+
+// Out-of-line halves of the inline functions below, only called while enabled.
+uint64_t stats_clock(void);
+uint64_t stats_record(Stage stage, uint64_t start);
+void stats_count(uint64_t bytes);
+
+//
+// Returns a timestamp in nanoseconds, or 0 when statistics are disabled.
+// The check is inlined, so a disabled block loop pays only for a branch.
+//
+static inline uint64_t stats_now(void) {
+    return (stats_enabled && !stats_ignored) ? stats_clock() : 0;
+}
+
+//
+// Records the time since 'start' in the histogram of 'stage'.
+//
+// Returns the current timestamp, so consecutive stages can be chained.
+//
+static inline uint64_t stats_lap(Stage stage, uint64_t start) {
+    return (stats_enabled && !stats_ignored) ? stats_record(stage, start) : 0;
+}
+
+//
+// Counts one finished block carrying 'bytes' bytes of plaintext.
+//
+static inline void stats_block(uint64_t bytes) {
+    if (stats_enabled && !stats_ignored) {
+        stats_count(bytes);
+    }
+}
+
+//
+// Writes blocks, bytes, throughput and per-stage latency percentiles as JSON.
+//
+// Requires:
+//  program: name of the program recorded in the output
+//  statsfile: open and writable file stream
+//
+void stats_dump(const char *program, FILE *statsfile);